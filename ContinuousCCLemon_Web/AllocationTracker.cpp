@@ -0,0 +1,208 @@
+# include "AllocationTracker.hpp"
+# include <cstdlib>
+# include <new>
+# if SIV3D_PLATFORM(WEB)
+#	include <emscripten/heap.h>
+# endif
+
+namespace
+{
+	std::atomic<uint64> g_count{ 0 };
+
+	std::atomic<uint64> g_bytes{ 0 };
+
+	std::atomic<uint64> g_liveBytes{ 0 };
+
+	std::atomic<uint64> g_peakBytes{ 0 };
+
+	uint64 g_frameBeginCount = 0;
+
+	uint64 g_frameBeginBytes = 0;
+
+	uint64 g_lastFrameCount = 0;
+
+	uint64 g_lastFrameBytes = 0;
+
+	uint64 g_framesSinceReset = 0;
+
+	std::array<AllocationSite*, AllocationTracker::MaxSites> g_sites{};
+
+	std::atomic<size_t> g_siteCount{ 0 };
+
+	thread_local AllocationSite* t_currentSite = nullptr;
+
+# if CCLEMON_TRACK_ALLOCATIONS
+
+	AllocationSite& UntaggedSite() noexcept
+	{
+		static AllocationSite site{ U"(untagged)" };
+		return site;
+	}
+
+	// 確保したサイズをブロックの先頭に置く。max_align_t の境界を保つ
+	constexpr size_t HeaderSize = alignof(std::max_align_t);
+
+	void OnAllocate(size_t size) noexcept
+	{
+		g_count.fetch_add(1, std::memory_order_relaxed);
+		g_bytes.fetch_add(size, std::memory_order_relaxed);
+
+		const uint64 live = g_liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+		uint64 peak = g_peakBytes.load(std::memory_order_relaxed);
+		while ((peak < live) and (not g_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))) {}
+
+		AllocationSite* site = (t_currentSite ? t_currentSite : &UntaggedSite());
+		site->count.fetch_add(1, std::memory_order_relaxed);
+		site->bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	void* Allocate(size_t size)
+	{
+		void* block = std::malloc(size + HeaderSize);
+
+		if (block == nullptr)
+		{
+			throw std::bad_alloc{};
+		}
+
+		*static_cast<size_t*>(block) = size;
+		OnAllocate(size);
+		return static_cast<unsigned char*>(block) + HeaderSize;
+	}
+
+	void Deallocate(void* p) noexcept
+	{
+		if (p == nullptr) return;
+
+		void* block = static_cast<unsigned char*>(p) - HeaderSize;
+		g_liveBytes.fetch_sub(*static_cast<size_t*>(block), std::memory_order_relaxed);
+		std::free(block);
+	}
+
+# endif
+}
+
+AllocationSite::AllocationSite(const char32* _name) noexcept
+	: name{ _name }
+{
+	AllocationTracker::Register(*this);
+}
+
+void AllocationTracker::BeginFrame() noexcept
+{
+	const uint64 count = g_count.load(std::memory_order_relaxed);
+	const uint64 bytes = g_bytes.load(std::memory_order_relaxed);
+
+	g_lastFrameCount = (count - g_frameBeginCount);
+	g_lastFrameBytes = (bytes - g_frameBeginBytes);
+	g_frameBeginCount = count;
+	g_frameBeginBytes = bytes;
+	++g_framesSinceReset;
+}
+
+AllocationTracker::Stats AllocationTracker::GetStats() noexcept
+{
+	Stats stats;
+	stats.frameCount = g_lastFrameCount;
+	stats.frameBytes = g_lastFrameBytes;
+	stats.liveBytes = g_liveBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = g_peakBytes.load(std::memory_order_relaxed);
+# if SIV3D_PLATFORM(WEB)
+	stats.heapSize = emscripten_get_heap_size();
+# else
+	stats.heapSize = stats.peakBytes;
+# endif
+	return stats;
+}
+
+std::array<AllocationTracker::SiteStats, 4> AllocationTracker::GetTopSites() noexcept
+{
+	std::array<SiteStats, 4> result{};
+
+	const double frames = static_cast<double>(Max<uint64>(g_framesSinceReset, 1));
+	const size_t siteCount = Min(g_siteCount.load(std::memory_order_acquire), MaxSites);
+
+	for (size_t i = 0; i < siteCount; ++i)
+	{
+		const AllocationSite& site = *g_sites[i];
+		const SiteStats stats{ site.name, site.count.load(std::memory_order_relaxed) / frames, site.bytes.load(std::memory_order_relaxed) / frames };
+
+		if (stats.countPerFrame == 0) continue;
+
+		// 回数の多い順に挿入する
+		for (size_t k = 0; k < result.size(); ++k)
+		{
+			if (result[k].name.isEmpty() or (result[k].countPerFrame < stats.countPerFrame))
+			{
+				std::move_backward(result.begin() + k, result.end() - 1, result.end());
+				result[k] = stats;
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+void AllocationTracker::ResetSites() noexcept
+{
+	const size_t siteCount = Min(g_siteCount.load(std::memory_order_acquire), MaxSites);
+
+	for (size_t i = 0; i < siteCount; ++i)
+	{
+		g_sites[i]->count.store(0, std::memory_order_relaxed);
+		g_sites[i]->bytes.store(0, std::memory_order_relaxed);
+	}
+
+	g_framesSinceReset = 0;
+}
+
+void AllocationTracker::Register(AllocationSite& site) noexcept
+{
+	const size_t index = g_siteCount.fetch_add(1, std::memory_order_acq_rel);
+
+	if (index < MaxSites)
+	{
+		g_sites[index] = &site;
+	}
+}
+
+AllocationSite* AllocationTracker::Swap(AllocationSite* site) noexcept
+{
+	return std::exchange(t_currentSite, site);
+}
+
+# if CCLEMON_TRACK_ALLOCATIONS
+
+// 配列版・nothrow 版・サイズ付き delete の既定の実装はこれらを呼ぶ
+void* operator new(std::size_t size)
+{
+	return Allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+	return Allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	Deallocate(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	Deallocate(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	Deallocate(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+	Deallocate(p);
+}
+
+# endif
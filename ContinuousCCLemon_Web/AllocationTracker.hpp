@@ -0,0 +1,127 @@
+# pragma once
+# include <atomic>
+# include <Siv3D.hpp>
+
+/// @brief 1 のときグローバルな operator new / delete を置き換えてヒープ確保を集計する（デバッグビルドでは既定で有効）
+# ifndef CCLEMON_TRACK_ALLOCATIONS
+#	if SIV3D_BUILD(DEBUG)
+#		define CCLEMON_TRACK_ALLOCATIONS 1
+#	else
+#		define CCLEMON_TRACK_ALLOCATIONS 0
+#	endif
+# endif
+
+/// @brief ヒープ確保を集計する箇所
+/// @remark static な変数として定義し、AllocationScope で囲んだ範囲の確保がこの箇所に計上されます
+struct AllocationSite
+{
+	explicit AllocationSite(const char32* _name) noexcept;
+
+	const char32* name;
+
+	std::atomic<uint64> count{ 0 };
+
+	std::atomic<uint64> bytes{ 0 };
+};
+
+/// @brief ヒープ確保の回数・バイト数・ピークを集計する
+class AllocationTracker
+{
+public:
+
+	/// @brief 登録できる箇所の最大数
+	static constexpr size_t MaxSites = 32;
+
+	/// @brief 直近のフレームの統計
+	struct Stats
+	{
+		/// @brief 直近のフレームの確保回数
+		uint64 frameCount = 0;
+
+		/// @brief 直近のフレームの確保バイト数
+		uint64 frameBytes = 0;
+
+		/// @brief 現在確保されているバイト数
+		uint64 liveBytes = 0;
+
+		/// @brief 確保されていたバイト数の最大値
+		uint64 peakBytes = 0;
+
+		/// @brief ヒープ全体の大きさ。Web では wasm のメモリサイズ
+		uint64 heapSize = 0;
+	};
+
+	/// @brief 箇所ごとの 1 フレームあたりの確保回数
+	struct SiteStats
+	{
+		StringView name;
+
+		double countPerFrame = 0;
+
+		double bytesPerFrame = 0;
+	};
+
+	/// @brief 集計が有効なビルドかを返します。
+	[[nodiscard]]
+	static constexpr bool IsAvailable() noexcept
+	{
+		return CCLEMON_TRACK_ALLOCATIONS;
+	}
+
+	/// @brief フレームの最初に呼びます。前のフレームの確保回数を確定します。
+	static void BeginFrame() noexcept;
+
+	[[nodiscard]]
+	static Stats GetStats() noexcept;
+
+	/// @brief 1 フレームあたりの確保回数が多い箇所を返します。
+	[[nodiscard]]
+	static std::array<SiteStats, 4> GetTopSites() noexcept;
+
+	/// @brief 箇所ごとの累計をリセットします。
+	static void ResetSites() noexcept;
+
+private:
+
+	friend struct AllocationSite;
+
+	friend class AllocationScope;
+
+	static void Register(AllocationSite& site) noexcept;
+
+	static AllocationSite* Swap(AllocationSite* site) noexcept;
+};
+
+/// @brief スコープの間のヒープ確保を指定した箇所に計上する
+class AllocationScope
+{
+public:
+
+# if CCLEMON_TRACK_ALLOCATIONS
+
+	explicit AllocationScope(AllocationSite& site) noexcept
+		: m_previous{ AllocationTracker::Swap(&site) } {}
+
+	~AllocationScope()
+	{
+		AllocationTracker::Swap(m_previous);
+	}
+
+# else
+
+	explicit AllocationScope(AllocationSite&) noexcept {}
+
+# endif
+
+	AllocationScope(const AllocationScope&) = delete;
+
+	AllocationScope& operator =(const AllocationScope&) = delete;
+
+private:
+
+# if CCLEMON_TRACK_ALLOCATIONS
+
+	AllocationSite* m_previous;
+
+# endif
+};
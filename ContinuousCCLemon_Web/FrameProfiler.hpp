@@ -0,0 +1,249 @@
+# pragma once
+# include <Siv3D.hpp>
+# include "AllocationTracker.hpp"
+
+/// @brief フレーム内の区間ごとの処理時間を計測する
+/// @remark 無効の間は ScopedProfile がフラグを 1 回見るだけなので、常に埋め込んでおいてよい
+class FrameProfiler
+{
+public:
+
+	/// @brief 計測する区間
+	enum class Section : uint8
+	{
+		/// @brief フレーム全体 (BeginFrame から次の BeginFrame まで)
+		Frame,
+
+		/// @brief タッチ・キー入力の処理
+		Input,
+
+		/// @brief client.update() / connect()
+		Network,
+
+		/// @brief Multiplayer_Photon::update() 内の JS コールバックの処理
+		PhotonService,
+
+		/// @brief updateGame の追いつきループ
+		Simulation,
+
+		/// @brief 描画と UI
+		Draw,
+
+		Count,
+	};
+
+	static constexpr size_t SectionCount = static_cast<size_t>(Section::Count);
+
+	/// @brief 統計を取るフレーム数
+	static constexpr size_t HistorySize = 240;
+
+	/// @brief 区間ごとの統計（ミリ秒）
+	struct Stats
+	{
+		double last = 0;
+
+		double mean = 0;
+
+		double p99 = 0;
+	};
+
+	[[nodiscard]]
+	static bool IsEnabled() noexcept
+	{
+		return Instance().m_enabled;
+	}
+
+	/// @brief 計測を有効・無効にします。切り替えると統計と箇所ごとの確保回数はリセットされます。
+	static void SetEnabled(bool enabled)
+	{
+		auto& self = Instance();
+		if (self.m_enabled == enabled) return;
+		self = FrameProfiler{};
+		self.m_enabled = enabled;
+		AllocationTracker::ResetSites();
+	}
+
+	/// @brief 計測とオーバーレイ表示を切り替えます。
+	static void Toggle()
+	{
+		SetEnabled(not IsEnabled());
+	}
+
+	/// @brief フレームの最初に呼びます。前のフレームの計測結果を履歴に積みます。
+	static void BeginFrame()
+	{
+		auto& self = Instance();
+		if (not self.m_enabled) return;
+
+		const uint64 now = Time::GetMicrosec();
+		if (self.m_frameBegin != 0)
+		{
+			self.m_current[static_cast<size_t>(Section::Frame)] = static_cast<double>(now - self.m_frameBegin);
+
+			for (size_t i = 0; i < SectionCount; ++i)
+			{
+				self.m_history[i][self.m_head] = self.m_current[i] / 1000.0;
+			}
+			self.m_head = (self.m_head + 1) % HistorySize;
+			self.m_count = Min(self.m_count + 1, HistorySize);
+		}
+
+		self.m_current.fill(0);
+		self.m_frameBegin = now;
+	}
+
+	/// @brief 区間の処理時間を加算します。同じフレームで複数回呼ばれた場合は合計されます。
+	static void Add(Section section, uint64 microsec) noexcept
+	{
+		Instance().m_current[static_cast<size_t>(section)] += static_cast<double>(microsec);
+	}
+
+	/// @brief 直近のフレームの統計を返します。
+	[[nodiscard]]
+	static std::array<Stats, SectionCount> GetStats()
+	{
+		const auto& self = Instance();
+		std::array<Stats, SectionCount> result{};
+
+		if (self.m_count == 0) return result;
+
+		const size_t lastIndex = (self.m_head + HistorySize - 1) % HistorySize;
+
+		for (size_t i = 0; i < SectionCount; ++i)
+		{
+			std::array<double, HistorySize> samples;
+			std::copy_n(self.m_history[i].begin(), self.m_count, samples.begin());
+
+			double sum = 0;
+			for (size_t k = 0; k < self.m_count; ++k)
+			{
+				sum += samples[k];
+			}
+
+			const size_t p99Index = Min(self.m_count - 1, static_cast<size_t>(self.m_count * 0.99));
+			std::nth_element(samples.begin(), samples.begin() + p99Index, samples.begin() + self.m_count);
+
+			result[i] = Stats{ self.m_history[i][lastIndex], sum / self.m_count, samples[p99Index] };
+		}
+
+		return result;
+	}
+
+	[[nodiscard]]
+	static StringView GetName(Section section) noexcept
+	{
+		constexpr std::array<StringView, SectionCount> names = { U"frame", U"input", U"network", U"photon", U"simulation", U"draw" };
+		return names[static_cast<size_t>(section)];
+	}
+
+	/// @brief 区間の中のヒープ確保を計上する箇所を返します。
+	[[nodiscard]]
+	static AllocationSite& GetAllocationSite(Section section) noexcept
+	{
+		static std::array<AllocationSite, SectionCount> sites = {
+			AllocationSite{ U"frame" }, AllocationSite{ U"input" }, AllocationSite{ U"network" },
+			AllocationSite{ U"photon" }, AllocationSite{ U"simulation" }, AllocationSite{ U"draw" } };
+		return sites[static_cast<size_t>(section)];
+	}
+
+	/// @brief 計測が有効なとき、統計を画面左下に描画します。
+	static void DrawOverlay(const Font& font)
+	{
+		if (not IsEnabled()) return;
+
+		static AllocationSite allocationSite{ U"profilerOverlay" };
+		AllocationScope allocationScope{ allocationSite };
+
+		if (AllocationTracker::IsAvailable())
+		{
+			DrawAllocationOverlay(font);
+		}
+
+		const auto stats = GetStats();
+		const double lineHeight = 16;
+		const Vec2 origin{ 5, Scene::Height() - 5 - lineHeight * (SectionCount + 1) };
+
+		RectF{ origin, 250, lineHeight * (SectionCount + 1) }.draw(ColorF{ 0, 0.6 });
+		font(U"section").draw(12, origin, Palette::White);
+		font(U"last / mean / p99 (ms)").draw(12, origin.movedBy(90, 0), Palette::White);
+
+		for (size_t i = 0; i < SectionCount; ++i)
+		{
+			const Vec2 pos = origin.movedBy(0, lineHeight * (i + 1));
+			font(GetName(static_cast<Section>(i))).draw(12, pos, Palette::White);
+			font(U"{:.2f} / {:.2f} / {:.2f}"_fmt(stats[i].last, stats[i].mean, stats[i].p99)).draw(12, pos.movedBy(90, 0), Palette::White);
+		}
+	}
+
+private:
+
+	static void DrawAllocationOverlay(const Font& font)
+	{
+		const auto stats = AllocationTracker::GetStats();
+		const auto sites = AllocationTracker::GetTopSites();
+		const double lineHeight = 16;
+		const Vec2 origin{ 5, Scene::Height() - 5 - lineHeight * (SectionCount + 1) - lineHeight * (sites.size() + 2) };
+
+		RectF{ origin, 250, lineHeight * (sites.size() + 2) }.draw(ColorF{ 0, 0.6 });
+		font(U"alloc/frame: {} ({} B)"_fmt(stats.frameCount, stats.frameBytes)).draw(12, origin, Palette::White);
+		font(U"live/peak/heap: {} / {} / {} KB"_fmt(stats.liveBytes / 1024, stats.peakBytes / 1024, stats.heapSize / 1024)).draw(12, origin.movedBy(0, lineHeight), Palette::White);
+
+		for (size_t i = 0; i < sites.size(); ++i)
+		{
+			if (sites[i].name.isEmpty()) break;
+
+			const Vec2 pos = origin.movedBy(0, lineHeight * (i + 2));
+			font(sites[i].name).draw(12, pos, Palette::White);
+			font(U"{:.1f} / frame"_fmt(sites[i].countPerFrame)).draw(12, pos.movedBy(120, 0), Palette::White);
+		}
+	}
+
+	bool m_enabled = false;
+
+	uint64 m_frameBegin = 0;
+
+	std::array<double, SectionCount> m_current{};
+
+	std::array<std::array<double, HistorySize>, SectionCount> m_history{};
+
+	size_t m_head = 0;
+
+	size_t m_count = 0;
+
+	static FrameProfiler& Instance() noexcept
+	{
+		static FrameProfiler instance;
+		return instance;
+	}
+};
+
+/// @brief スコープを抜けるまでの時間を指定した区間に加算する
+class ScopedProfile
+{
+public:
+
+	explicit ScopedProfile(FrameProfiler::Section section) noexcept
+		: m_section{ section }
+		, m_begin{ FrameProfiler::IsEnabled() ? Time::GetMicrosec() : 0 }
+		, m_allocationScope{ FrameProfiler::GetAllocationSite(section) } {}
+
+	~ScopedProfile()
+	{
+		if (m_begin != 0)
+		{
+			FrameProfiler::Add(m_section, Time::GetMicrosec() - m_begin);
+		}
+	}
+
+	ScopedProfile(const ScopedProfile&) = delete;
+
+	ScopedProfile& operator =(const ScopedProfile&) = delete;
+
+private:
+
+	FrameProfiler::Section m_section;
+
+	uint64 m_begin;
+
+	AllocationScope m_allocationScope;
+};
@@ -1,5 +1,8 @@
 # include <Siv3D.hpp> // Siv3D v0.6.16
 # include "Multiplayer_Photon.hpp"
+# include "FrameProfiler.hpp"
+# include "TraceRecorder.hpp"
+# include "TaskScheduler.hpp"
 # include "PHOTON_APP_ID.SECRET"
 
 /*
@@ -14,20 +17,150 @@
 相手のhpを削り切るか、タメポイントを一定量集めると打てる必殺技で勝利
 */
 
+//1 のとき、Main() の while ループの代わりにブラウザの requestAnimationFrame からフレームを 1 回ずつ呼ぶ (ReleaseNoAsyncify)
+//ASYNCIFY なしでビルドできる。フレームの途中では待てないので、省電力中はフレームを呼ぶ間隔を広げる
+# ifndef CCLEMON_MAIN_LOOP_CALLBACK
+#	define CCLEMON_MAIN_LOOP_CALLBACK 0
+# endif
+
+# if SIV3D_PLATFORM(WEB)
+EM_JS(double, siv3dGetInputTimeStamp, (), {
+	return performance.now();
+	});
+# endif
+
+//入力イベントの時刻(ミリ秒)。Web では event.timeStamp と同じ基準
+double GetInputTimeStamp() {
+# if SIV3D_PLATFORM(WEB)
+	return siv3dGetInputTimeStamp();
+# else
+	return Time::GetMicrosec() / 1000.0;
+# endif
+}
+
+# if SIV3D_PLATFORM(WEB)
+EM_JS(void, siv3dDownloadText, (const char* fileName, const char* text), {
+	const blob = new Blob([UTF8ToString(text)], { type: "application/json" });
+	const url = URL.createObjectURL(blob);
+	const a = document.createElement("a");
+	a.href = url;
+	a.download = UTF8ToString(fileName);
+	a.click();
+	setTimeout(() => URL.revokeObjectURL(url), 1000);
+	});
+# endif
+
+//記録したトレースを Chrome のトレース形式で書き出す。Web ではダウンロード、それ以外ではファイルに保存
+void ExportTrace() {
+	const String fileName = U"trace_{}.json"_fmt(DateTime::Now().format(U"yyyyMMdd_HHmmss"));
+# if SIV3D_PLATFORM(WEB)
+	siv3dDownloadText(fileName.toUTF8().c_str(), TraceRecorder::ToJSON().toUTF8().c_str());
+# else
+	TraceRecorder::Save(fileName);
+# endif
+}
+
+# if SIV3D_PLATFORM(WEB)
+EM_JS(void, siv3dStartupMark, (const char* name, double time), {
+	globalThis.siv3dStartupTimeline?.mark(UTF8ToString(name), time);
+	});
+
+EM_JS(void, siv3dStartupReport, (const char* version, const char* build, double frameCost), {
+	globalThis.siv3dStartupTimeline?.report({ version: UTF8ToString(version), build: UTF8ToString(build), frameCost: Math.round(frameCost * 1000) / 1000 });
+	});
+# endif
+
+//ビルドの種類。ビルドごとに起動時間・フレームの処理時間を比べるため、記録に含める (tools/compare_builds.py)
+# if !SIV3D_PLATFORM(WEB)
+constexpr StringView BuildName = U"native";
+# elif CCLEMON_MAIN_LOOP_CALLBACK
+constexpr StringView BuildName = U"noasyncify";
+# elif CCLEMON_THREADS
+constexpr StringView BuildName = U"mt";
+# else
+constexpr StringView BuildName = U"asyncify";
+# endif
+
+//起動からマッチ開始までの時刻を記録する
+//Web ではページ側 (web-player.html) の記録と同じ performance.now() 基準で送り、ページ側でまとめて 1 件のレコードにする
+class StartupTimeline {
+public:
+	//同じ名前は最初の 1 回だけ記録する
+	void mark(StringView name) {
+		if (m_reported or m_marks.any([&](const auto& m) { return m.first == name; })) return;
+
+		const double time = GetInputTimeStamp();
+		m_marks.emplace_back(name, time);
+# if SIV3D_PLATFORM(WEB)
+		siv3dStartupMark(name.toUTF8().c_str(), time);
+# endif
+	}
+
+	//記録を送るまでの、1 フレームの処理にかかった時間(待ち時間を除く)を足していく
+	void addFrameCost(double millisec) noexcept {
+		m_frameCostTotal += millisec;
+		++m_frameCostCount;
+	}
+
+	void report(StringView version) {
+		if (m_reported) return;
+		m_reported = true;
+
+		const double frameCost = (m_frameCostCount > 0) ? (m_frameCostTotal / m_frameCostCount) : 0.0;
+
+# if SIV3D_PLATFORM(WEB)
+		siv3dStartupReport(version.toUTF8().c_str(), BuildName.toUTF8().c_str(), frameCost);
+# else
+		String record = U"[startup] v{} {} frameCost={:.3f}ms"_fmt(version, BuildName, frameCost);
+		for (const auto& [name, time] : m_marks) {
+			record += U" {}={:.1f}ms"_fmt(name, time - m_marks.front().second);
+		}
+		Logger << record;
+# endif
+	}
+
+	bool isReported() const noexcept { return m_reported; }
+
+private:
+	Array<std::pair<String, double>> m_marks;
+	bool m_reported = false;
+	double m_frameCostTotal = 0;
+	uint64 m_frameCostCount = 0;
+};
+
 class InputManageFlag {
 public:
-	InputManageFlag() noexcept : m_prePressed(false), m_pressed(false), m_duration(0) {}
+	InputManageFlag() noexcept : m_prePressed(false), m_pressed(false), m_duration(0), m_downTimeStamp(0), m_upTimeStamp(0) {}
+
+	void update(bool currentPressed) {
+		update(currentPressed, GetInputTimeStamp());
+	}
 
-	void update(bool currentPressed) noexcept {
+	//押した・離した瞬間の時刻が分かっている場合はフレームより細かい時刻を渡す
+	void update(bool currentPressed, double edgeTimeStamp) noexcept {
 		m_prePressed = m_pressed;
 		m_pressed = currentPressed;
 
 		if (down()) {
 			m_stopwatch.restart();
+			m_downTimeStamp = edgeTimeStamp;
+		}
+		else if (up()) {
+			m_upTimeStamp = edgeTimeStamp;
 		}
 		m_duration = pressed() or up() ? m_stopwatch.elapsed() : 0s;
 	}
 
+	//押した瞬間の時刻(ミリ秒、GetInputTimeStamp と同じ基準)
+	[[nodiscard]] constexpr double downTimeStamp() const noexcept {
+		return m_downTimeStamp;
+	}
+
+	//最後に押した、または離した瞬間の時刻
+	[[nodiscard]] constexpr double edgeTimeStamp() const noexcept {
+		return m_pressed ? m_downTimeStamp : m_upTimeStamp;
+	}
+
 	[[nodiscard]] constexpr bool down() const noexcept {
 		return m_pressed && !m_prePressed;
 	}
@@ -48,55 +181,240 @@ private:
 	bool m_pressed;
 	Stopwatch m_stopwatch;
 	Duration m_duration;
+	double m_downTimeStamp;
+	double m_upTimeStamp;
 };
 
-struct TouchInfo {
-	int32 id;
-	Vec2 pos;
+//キーボードとマウスが最後に変化した時刻(ミリ秒)。Web では JS のイベントリスナが書き込む
+struct InputEdgeTimeStamps {
+	double space = 0;
+	double shift = 0;
+	double mouseLeft = 0;
+
+	//フレームの最初に呼ぶ
+	void update()
+	{
+		m_frameBegin = m_frameEnd;
+		m_frameEnd = GetInputTimeStamp();
+	}
+
+	//前のフレームからこのフレームまでに記録された時刻のうち最も新しいもの。なければこのフレームの時刻
+	double latest(double a, double b) const
+	{
+		double result = 0;
+		for (double t : { a, b }) {
+			if (m_frameBegin < t and t <= m_frameEnd) {
+				result = Max(result, t);
+			}
+		}
+		return (result > 0) ? result : m_frameEnd;
+	}
+
+private:
+	double m_frameBegin = 0;
+	double m_frameEnd = 0;
 };
 
-// タッチ情報を取得する関数
-Array<TouchInfo> GetMyTouches() {
-# if SIV3D_PLATFORM(WEB)
-	Array<TouchInfo> result = Array<TouchInfo>(EM_ASM_INT({ return window.myTouches.length; }));
+InputEdgeTimeStamps InputEdges;
+
+//タブの表示状態。Web では visibilitychange と、埋め込み先でのスクロール (web-player.html) で更新される
+struct PageVisibilityState {
+	//非表示になったときに呼ばれる。この後フレームは止まるので、送信などはここで済ませる
+	std::function<void()> onHidden;
 
-	EM_ASM({
-		const touches = window.myTouches;
+	bool hidden = false;
 
-		for (let i = 0; i < touches.length; i++) {
-			const touch = touches[i];
-			const touchPtr = $0 + i * 24; // TouchInfo のサイズに応じて調整
+	//非表示になった時刻と、戻った時刻(ミリ秒)
+	double hiddenAt = 0;
+	double shownAt = 0;
 
-			const adjusted = siv3dAdjustPoint(touch.pageX, touch.pageY);
+	void change(bool isHidden, double timeStamp)
+	{
+		if (hidden == isHidden) return;
+		hidden = isHidden;
 
-			setValue(touchPtr, touch.identifier, 'i32');
-			setValue(touchPtr + 8, adjusted.x, 'double');
-			setValue(touchPtr + 16, adjusted.y, 'double');
+		if (hidden) {
+			hiddenAt = timeStamp;
+			if (onHidden) {
+				onHidden();
+			}
+		}
+		else {
+			shownAt = timeStamp;
+			m_resumed = true;
 		}
-		}, result.data());
+	}
 
-	for (auto& touch : result)
+	//戻ってから最初のフレームで 1 回だけ true を返す
+	bool takeResume()
 	{
-		touch.pos = Scene::ClientToScene(touch.pos);
+		return std::exchange(m_resumed, false);
 	}
 
-	return result;
-# else
-	return Array<TouchInfo>();
-# endif
+	//最後に非表示だった時間(ミリ秒)
+	double hiddenMillisec() const
+	{
+		return shownAt - hiddenAt;
+	}
+
+private:
+	bool m_resumed = false;
+};
+
+PageVisibilityState PageVisibility;
+
+# if SIV3D_PLATFORM(WEB)
+EM_JS(void, setupVisibilityHandler, (), {
+	function notify() {
+		_ccLemonVisibilityChangeCallback(document.hidden || globalThis.siv3dOutOfView === true, performance.now());
+	}
+	document.addEventListener("visibilitychange", notify);
+	window.addEventListener("siv3d-viewport", notify);
+	notify();
+	});
+
+//部屋にいるかをページに知らせる。埋め込みのページは、部屋の外で見えなくなったときだけ解放する
+EM_JS(void, siv3dSetInRoom, (bool inRoom), {
+	globalThis.siv3dInRoom = inRoom;
+	});
+
+extern "C"
+{
+	__attribute__((used, export_name("ccLemonVisibilityChangeCallback")))
+	void ccLemonVisibilityChangeCallback(bool hidden, double timeStamp)
+	{
+		PageVisibility.change(hidden, timeStamp);
+	}
 }
+# endif
+
+# if SIV3D_PLATFORM(WEB)
+EM_JS(void, setupInputTimeStampHandler, (double* space, double* shift, double* mouseLeft), {
+	function onKey(e) {
+		if (e.repeat) return;
+		if (e.code === "Space") {
+			HEAPF64[space >> 3] = e.timeStamp;
+		}
+		else if (e.code === "ShiftLeft" || e.code === "ShiftRight") {
+			HEAPF64[shift >> 3] = e.timeStamp;
+		}
+	}
+
+	function onMouse(e) {
+		if (e.button === 0) {
+			HEAPF64[mouseLeft >> 3] = e.timeStamp;
+		}
+	}
+
+	window.addEventListener("keydown", onKey, true);
+	window.addEventListener("keyup", onKey, true);
+	Module['canvas'].addEventListener("mousedown", onMouse, true);
+	window.addEventListener("mouseup", onMouse, true);
+	});
+# endif
+
+//タッチ 1 点の情報
+struct TouchInfo {
+	int32 id;
+	Vec2 pos;
+	double pressTimeStamp = 0; //触れた瞬間の時刻(ミリ秒、GetInputTimeStamp と同じ基準)
+};
+
+//JS のタッチイベントを 1 件ずつ記録したもの
+//JS 側には offsetof でレイアウトを渡すので、メンバを変えても JS を直す必要はない
+struct TouchRecord {
+	enum Type : int32 {
+		Start,
+		Move,
+		End,
+	};
+
+	int32 id;
+	int32 type;
+	double x; //クライアント座標
+	double y;
+	double timeStamp; //event.timeStamp (ミリ秒)
+};
+
+//JS が書き込み、C++ が毎フレーム読み出すタッチイベントのリングバッファ
+struct TouchRecordBuffer {
+	static constexpr uint32 Capacity = 256;
+
+	std::array<TouchRecord, Capacity> records;
+	uint32 writeIndex = 0; //JS 側が進める
+	uint32 readIndex = 0; //C++ 側が進める
+};
+
+TouchRecordBuffer TouchRecords;
 
 class TouchesType
 {
 private:
+	static constexpr size_t MaxTouches = 10;
+
 	Array<TouchInfo> m_touches;
 	Array<TouchInfo> m_preTouches;
+
+	double m_lastReleaseTimeStamp = 0;
+
+	TouchInfo* find(int32 id)
+	{
+		for (auto& touch : m_touches)
+		{
+			if (touch.id == id)
+			{
+				return &touch;
+			}
+		}
+		return nullptr;
+	}
+
+	void apply(const TouchRecord& record)
+	{
+		const Vec2 pos = Scene::ClientToScene(Vec2{ record.x, record.y });
+
+		if (record.type == TouchRecord::End)
+		{
+			m_lastReleaseTimeStamp = record.timeStamp;
+			m_touches.remove_if([id = record.id](const TouchInfo& touch) { return touch.id == id; });
+		}
+		else if (auto touch = find(record.id))
+		{
+			touch->pos = pos;
+		}
+		else if (m_touches.size() < MaxTouches)
+		{
+			//取りこぼした start の代わりに move が来た場合もここで追加する
+			m_touches.push_back(TouchInfo{ record.id, pos, record.timeStamp });
+		}
+	}
 public:
 
 	void update()
 	{
+		if (m_touches.capacity() < MaxTouches)
+		{
+			//毎フレームの更新でメモリ確保が起きないように最初に確保しておく
+			m_touches.reserve(MaxTouches);
+			m_preTouches.reserve(MaxTouches);
+		}
+
 		m_preTouches = m_touches;
-		m_touches = GetMyTouches();
+
+		auto& buffer = TouchRecords;
+		const uint32 writeIndex = buffer.writeIndex;
+
+		if (writeIndex - buffer.readIndex > TouchRecordBuffer::Capacity)
+		{
+			//溢れて上書きされた分は捨て、残っている記録から作り直す
+			m_touches.clear();
+			buffer.readIndex = writeIndex - TouchRecordBuffer::Capacity;
+		}
+
+		for (; buffer.readIndex != writeIndex; ++buffer.readIndex)
+		{
+			apply(buffer.records[buffer.readIndex % TouchRecordBuffer::Capacity]);
+		}
 	}
 
 	const Array<TouchInfo>& getTouches() const
@@ -138,113 +456,388 @@ public:
 		}
 	}
 
-	template<class T>
-	TouchesType intersects(T&& shape) const
+	//最後に指が離れた時刻
+	double lastReleaseTimeStamp() const
 	{
-		TouchesType result;
-		for (const auto& touch : m_touches)
-		{
-			if (shape.intersects(touch.pos))
-			{
-				result.m_touches.push_back(touch);
-			}
-		}
-		return result;
+		return m_lastReleaseTimeStamp;
 	}
 };
 
 TouchesType Touches;
 
-# if SIV3D_PLATFORM(WEB)
-EM_JS(void, setupMultiTouchHandler, (), {
-	// グローバル変数を定義
-	window.myTouches = [];
+//画面に固定されたボタンの領域とタッチの対応を管理する
+//1 本の指が持てるボタンは 1 つで、ボタンは指が離れるか領域から出るまでその指のもの
+class TouchButtonRegistry
+{
+public:
+	using ButtonID = size_t;
 
-// タッチイベントの処理を設定
-const canvas = Module['canvas'];
+	ButtonID add(const RectF& rect)
+	{
+		if (m_count >= MaxButtons)
+		{
+			throw Error(U"TouchButtonRegistry: too many buttons");
+		}
+		m_buttons[m_count] = Button{ rect };
+		return m_count++;
+	}
 
-function updateTouches(e) {
-  window.myTouches = Array.from(e.touches);
-  //e.preventDefault(); // 任意：スクロール防止など
-}
+	//タッチの一覧を 1 回走査して各ボタンの状態を更新する。メモリ確保はしない
+	void update(const TouchesType& touches)
+	{
+		const double now = GetInputTimeStamp();
 
-canvas.addEventListener("touchstart", updateTouches, false);
-canvas.addEventListener("touchmove", updateTouches, false);
-canvas.addEventListener("touchend", updateTouches, false);
-	});
+		struct Candidate
+		{
+			bool ownerInside = false;
+			const TouchInfo* touch = nullptr; //持ち主がいなくなった場合に引き継ぐ指
+		};
+		std::array<Candidate, MaxButtons> candidates{};
 
-# endif
+		for (const auto& touch : touches.getTouches())
+		{
+			for (ButtonID i = 0; i < m_count; ++i)
+			{
+				if (not m_buttons[i].rect.intersects(touch.pos)) continue;
 
-void drawLoadingSpinner(const Vec2 center = Scene::Center(), double t = Scene::Time()) {
-	//ローディング画面
-	int32 t_ = static_cast<int32>(Floor(fmod(t / 0.1, 8)));
-	for (int32 i : step(8)) {
-		Vec2 n = Circular(1, i * Math::TwoPi / 8);
-		Line(Scene::Center() + n * 10, Arg::direction(n * 10)).draw(LineStyle::RoundCap, 4, t_ == i ? ColorF(1, 0.9) : ColorF(1, 0.5));
-	}
-}
+				auto& candidate = candidates[i];
+				if (m_buttons[i].ownerID == touch.id)
+				{
+					candidate.ownerInside = true;
+				}
+				else if (not candidate.touch or touch.pressTimeStamp < candidate.touch->pressTimeStamp)
+				{
+					//複数の指が入ってきたら先に触れた方を優先する
+					candidate.touch = &touch;
+				}
+				break;
+			}
+		}
 
-enum class PlayerState : uint8
-{
-	Charge, //タメ
-	Attack, //攻撃
-	Defense, //防御
-};
+		for (ButtonID i = 0; i < m_count; ++i)
+		{
+			auto& button = m_buttons[i];
+			const auto& candidate = candidates[i];
 
-struct PlayerData
-{
-	//プレイヤーのデータ
-	PlayerState state = PlayerState::Charge;
-	double hp = 100;
-	double chargePoint = 0;
-	PlayerData() = default;
-	PlayerData(PlayerState state, double hp, double chargePoint)
-		: state(state), hp(hp), chargePoint(chargePoint) {
+			if (button.ownerID != NoOwner and not candidate.ownerInside)
+			{
+				//指が離れたならその時刻、領域から出ただけなら現在の時刻で離したことにする
+				const bool lifted = not touches.getTouch(button.ownerID);
+				button.releaseTimeStamp = lifted ? touches.lastReleaseTimeStamp() : now;
+				button.ownerID = NoOwner;
+			}
+
+			if (button.ownerID == NoOwner and candidate.touch)
+			{
+				//このフレームで触れた指ならその時刻、外から滑り込んできた指なら現在の時刻
+				const bool touchedHere = (m_lastUpdateTimeStamp < candidate.touch->pressTimeStamp);
+				button.ownerID = candidate.touch->id;
+				button.pressTimeStamp = touchedHere ? candidate.touch->pressTimeStamp : now;
+			}
+
+			button.pressed = (button.ownerID != NoOwner);
+		}
+
+		m_lastUpdateTimeStamp = now;
 	}
-	PlayerData(double hp, double chargePoint)
-		: hp(hp), chargePoint(chargePoint) {
+
+	bool pressed(ButtonID id) const
+	{
+		return m_buttons[id].pressed;
 	}
-	template <class Archive>
-	void SIV3D_SERIALIZE(Archive& archive)
+
+	//ボタンを押している指の ID。押されていなければ none
+	Optional<int32> owner(ButtonID id) const
 	{
-		archive(state, hp, chargePoint);
+		if (m_buttons[id].ownerID == NoOwner) return none;
+		return m_buttons[id].ownerID;
 	}
-};
 
-enum class GameState : uint8
-{
-	//ゲームの状態
-	Waiting, //待機中
-	Playing, //プレイ中
-	Finished, //終了
-};
+	double pressTimeStamp(ButtonID id) const
+	{
+		return m_buttons[id].pressTimeStamp;
+	}
 
-//複数プレイヤーで共有するデータ
-class ShareGameData
-{
+	//最後に押された、または離された時刻
+	double edgeTimeStamp(ButtonID id) const
+	{
+		const auto& button = m_buttons[id];
+		return button.pressed ? button.pressTimeStamp : button.releaseTimeStamp;
+	}
 
-public:
-	std::array<PlayerData, 2> players;
-	GameState gameState = GameState::Waiting;
-	int32 wonPlayer = 0; //勝利したプレイヤーのインデックス。-1は未定義
+private:
+	static constexpr size_t MaxButtons = 8;
 
-	double maxHp = 100;
-	double maxChargePoint = 200;
+	static constexpr int32 NoOwner = -1;
 
-	ShareGameData() {}
+	struct Button
+	{
+		RectF rect;
+		bool pressed = false;
+		int32 ownerID = NoOwner;
+		double pressTimeStamp = 0;
+		double releaseTimeStamp = 0;
+	};
 
-	Optional<int32> updateGame(double dt) {
-		int32 wonPlayer = 0;
-		if (gameState != GameState::Playing) return none;
+	std::array<Button, MaxButtons> m_buttons;
 
-		auto pre_players = players;
+	size_t m_count = 0;
 
-		for (auto [i, player] : IndexedRef(players)) {
-			if (player.state == PlayerState::Charge) {
-				auto& enemy = players[1 - i];
-				if (enemy.state != PlayerState::Attack or (pre_players[1 - i].chargePoint <= 0)) {
-					player.chargePoint += 10 * dt; //タメポイントを増加
-				}
+	double m_lastUpdateTimeStamp = 0;
+};
+
+# if SIV3D_PLATFORM(WEB)
+EM_JS(void, setupMultiTouchHandler, (void* records, uint32 capacity, uint32* writeIndexPtr, int32 recordSize, int32 offsetId, int32 offsetType, int32 offsetX, int32 offsetY, int32 offsetTimeStamp), {
+	// タッチイベントの処理を設定
+	const canvas = Module['canvas'];
+
+	// 変化したタッチを 1 件ずつリングバッファに書き込む
+	function recordTouches(type) {
+		return function (e) {
+			for (const touch of e.changedTouches) {
+				const index = HEAPU32[writeIndexPtr >> 2];
+				const ptr = records + (index % capacity) * recordSize;
+				const adjusted = siv3dAdjustPoint(touch.pageX, touch.pageY);
+
+				HEAP32[(ptr + offsetId) >> 2] = touch.identifier;
+				HEAP32[(ptr + offsetType) >> 2] = type;
+				HEAPF64[(ptr + offsetX) >> 3] = adjusted.x;
+				HEAPF64[(ptr + offsetY) >> 3] = adjusted.y;
+				HEAPF64[(ptr + offsetTimeStamp) >> 3] = e.timeStamp;
+
+				HEAPU32[writeIndexPtr >> 2] = (index + 1) >>> 0;
+			}
+			//e.preventDefault(); // 任意：スクロール防止など
+		};
+	}
+
+	canvas.addEventListener("touchstart", recordTouches(0), false);
+	canvas.addEventListener("touchmove", recordTouches(1), false);
+	canvas.addEventListener("touchend", recordTouches(2), false);
+	canvas.addEventListener("touchcancel", recordTouches(2), false);
+	});
+
+void SetupMultiTouchHandler()
+{
+	setupMultiTouchHandler(TouchRecords.records.data(), TouchRecordBuffer::Capacity, &TouchRecords.writeIndex, sizeof(TouchRecord),
+		offsetof(TouchRecord, id), offsetof(TouchRecord, type), offsetof(TouchRecord, x), offsetof(TouchRecord, y), offsetof(TouchRecord, timeStamp));
+}
+
+# endif
+
+//フォントごとにラスタライズ済みの文字を覚えておき、グリフキャッシュのヒット・ミスを数える
+class GlyphCache {
+public:
+	explicit GlyphCache(const Font& font) : m_font(font) {}
+
+	const Font& font() const noexcept { return m_font; }
+
+	//chars のうちまだラスタライズしていない文字をまとめてラスタライズしておく
+	void prewarm(StringView chars) {
+		m_missing.clear();
+		for (const char32 ch : chars) {
+			if (m_rasterized.insert(ch).second) {
+				m_missing.push_back(ch);
+			}
+		}
+		if (not m_missing.isEmpty()) {
+			m_font.preload(m_missing);
+		}
+	}
+
+	//文字列を並べる。初めて使う文字はここでラスタライズされるのでミスとして数える
+	Array<Glyph> layout(StringView text) {
+		for (const char32 ch : text) {
+			if (m_rasterized.insert(ch).second) {
+				++m_misses;
+			}
+			else {
+				++m_hits;
+			}
+		}
+		return m_font.getGlyphs(text);
+	}
+
+	uint64 hits() const noexcept { return m_hits; }
+	uint64 misses() const noexcept { return m_misses; }
+
+private:
+	Font m_font;
+	HashSet<char32> m_rasterized;
+	String m_missing;
+	uint64 m_hits = 0;
+	uint64 m_misses = 0;
+};
+
+//文字列が変わったときだけグリフを並べ直して描く 1 行の文字列
+class CachedText {
+public:
+	explicit CachedText(GlyphCache& cache) : m_cache(&cache) {}
+
+	//前回と違う文字列のときだけ並べ直す
+	CachedText& set(StringView text) {
+		if (m_key or text != m_text) {
+			m_key.reset();
+			relayout(text);
+		}
+		return *this;
+	}
+
+	//key が前回と違うときだけ makeText() で文字列を作って並べ直す。数字だけが変わる文字列を毎フレーム作らないようにする
+	template <class Fty>
+	CachedText& set(int64 key, Fty makeText) {
+		if (m_key != key) {
+			m_key = key;
+			relayout(makeText());
+		}
+		return *this;
+	}
+
+	const String& text() const noexcept { return m_text; }
+
+	//左上を指定して描く
+	void draw(double size, const Vec2& pos, const ColorF& color = Palette::White) const {
+		const double scale = (size / m_cache->font().fontSize());
+		Vec2 penPos = pos;
+		for (const auto& glyph : m_glyphs) {
+			glyph.texture.scaled(scale).draw(penPos + glyph.getOffset(scale), color);
+			penPos.x += (glyph.xAdvance * scale);
+		}
+	}
+
+	void draw(const Vec2& pos, const ColorF& color = Palette::White) const {
+		draw(m_cache->font().fontSize(), pos, color);
+	}
+
+	//ベースラインの左端を指定して描く
+	void drawBase(double size, const Vec2& pos, const ColorF& color = Palette::White) const {
+		const double scale = (size / m_cache->font().fontSize());
+		draw(size, pos.movedBy(0, -m_cache->font().ascender() * scale), color);
+	}
+
+	//中心を指定して描く
+	void drawAt(double size, const Vec2& center, const ColorF& color = Palette::White) const {
+		const double scale = (size / m_cache->font().fontSize());
+		draw(size, center - Vec2{ m_width, static_cast<double>(m_cache->font().height()) } * scale / 2, color);
+	}
+
+	void drawAt(const Vec2& center, const ColorF& color = Palette::White) const {
+		drawAt(m_cache->font().fontSize(), center, color);
+	}
+
+private:
+	GlyphCache* m_cache;
+	String m_text;
+	Optional<int64> m_key;
+	Array<Glyph> m_glyphs;
+	double m_width = 0;
+
+	void relayout(StringView text) {
+		m_text = text;
+		m_glyphs = m_cache->layout(text);
+		m_width = 0;
+		for (const auto& glyph : m_glyphs) {
+			m_width += glyph.xAdvance;
+		}
+	}
+};
+
+void drawLoadingSpinner(const Vec2 center = Scene::Center(), double t = Scene::Time()) {
+	//ローディング画面
+	int32 t_ = static_cast<int32>(Floor(fmod(t / 0.1, 8)));
+	for (int32 i : step(8)) {
+		Vec2 n = Circular(1, i * Math::TwoPi / 8);
+		Line(Scene::Center() + n * 10, Arg::direction(n * 10)).draw(LineStyle::RoundCap, 4, t_ == i ? ColorF(1, 0.9) : ColorF(1, 0.5));
+	}
+}
+
+enum class PlayerState : uint8
+{
+	Charge, //タメ
+	Attack, //攻撃
+	Defense, //防御
+};
+
+struct PlayerData
+{
+	//プレイヤーのデータ
+	PlayerState state = PlayerState::Charge;
+	double hp = 100;
+	double chargePoint = 0;
+	PlayerData() = default;
+	PlayerData(PlayerState state, double hp, double chargePoint)
+		: state(state), hp(hp), chargePoint(chargePoint) {
+	}
+	PlayerData(double hp, double chargePoint)
+		: hp(hp), chargePoint(chargePoint) {
+	}
+	template <class Archive>
+	void SIV3D_SERIALIZE(Archive& archive)
+	{
+		archive(state, hp, chargePoint);
+	}
+};
+
+enum class GameState : uint8
+{
+	//ゲームの状態
+	Waiting, //待機中
+	Playing, //プレイ中
+	Finished, //終了
+};
+
+//複数プレイヤーで共有するデータ
+class ShareGameData
+{
+
+public:
+	std::array<PlayerData, 2> players;
+	GameState gameState = GameState::Waiting;
+	int32 wonPlayer = 0; //勝利したプレイヤーのインデックス。-1は未定義
+
+	double maxHp = 100;
+	double maxChargePoint = 200;
+
+	int32 tick = 0; //プレイ開始からのシミュレーションのステップ数
+
+	ShareGameData() {}
+
+	//同期ずれ検出用のハッシュ。浮動小数点の細かい誤差は無視するよう丸めてから計算する
+	uint32 hash() const {
+		uint32 h = 2166136261u; //FNV-1a
+		auto mix = [&h](uint32 value) {
+			for (int32 i : step(4)) {
+				h ^= (value >> (i * 8)) & 0xFF;
+				h *= 16777619u;
+			}
+		};
+		mix(static_cast<uint32>(tick));
+		mix(static_cast<uint32>(gameState));
+		for (const auto& player : players) {
+			mix(static_cast<uint32>(player.state));
+			mix(static_cast<uint32>(static_cast<int64>(Math::Round(player.hp * 100))));
+			mix(static_cast<uint32>(static_cast<int64>(Math::Round(player.chargePoint * 100))));
+		}
+		return h;
+	}
+
+	Optional<int32> updateGame(double dt) {
+		int32 wonPlayer = 0;
+		if (gameState != GameState::Playing) return none;
+
+		++tick;
+
+		static constexpr TraceEventType TraceType{ U"updateGame", U"simulation", U"tick" };
+		ScopedTrace trace{ TraceType, tick };
+
+		auto pre_players = players;
+
+		for (auto [i, player] : IndexedRef(players)) {
+			if (player.state == PlayerState::Charge) {
+				auto& enemy = players[1 - i];
+				if (enemy.state != PlayerState::Attack or (pre_players[1 - i].chargePoint <= 0)) {
+					player.chargePoint += 10 * dt; //タメポイントを増加
+				}
 			}
 			else if (player.state == PlayerState::Attack) {
 				if (player.chargePoint > 0) {
@@ -320,176 +913,1602 @@ public:
 		return none;
 	}
 
-	template <class Archive>
-	void SIV3D_SERIALIZE(Archive& archive)
-	{
-		archive(players, gameState, wonPlayer, maxHp, maxChargePoint);
+	template <class Archive>
+	void SIV3D_SERIALIZE(Archive& archive)
+	{
+		archive(players, gameState, wonPlayer, maxHp, maxChargePoint, tick);
+	}
+};
+
+# if SIV3D_BUILD(DEBUG)
+//ホストの巻き戻し再シミュレーションにかかる時間を計測する(F9 キー)
+//TaskScheduler のワーカーで実行するので、結果は文字列で返してメインスレッドで表示する
+Array<String> BenchmarkRewind()
+{
+	constexpr double timeStep = 1.0 / 60;
+	constexpr int32 Iterations = 1000;
+
+	ShareGameData base;
+	base.gameState = GameState::Playing;
+	base.maxHp = 1000;
+	base.maxChargePoint = 1000;
+	base.players = { PlayerData(PlayerState::Attack, 1000, 500), PlayerData(PlayerState::Charge, 1000, 500) };
+
+	Array<String> lines;
+	for (int32 windowMs : { 50, 100, 200, 300, 400, 500 }) {
+		const int32 ticks = static_cast<int32>(Math::Ceil(windowMs / 1000.0 / timeStep));
+		uint32 checksum = 0;
+
+		Stopwatch stopwatch{ StartImmediately::Yes };
+		for (int32 i : step(Iterations)) {
+			//実際の巻き戻しと同じく、状態をコピーして変更を適用し、ステップごとにハッシュを取る
+			ShareGameData replayed = base;
+			replayed.players[1].state = (i % 2) ? PlayerState::Defense : PlayerState::Attack;
+			for ([[maybe_unused]] int32 t : step(ticks)) {
+				replayed.updateGame(timeStep);
+				checksum ^= replayed.hash();
+			}
+		}
+		const double elapsedUs = stopwatch.usF();
+
+		lines << U"rewind {}ms ({} ticks): {:.2f}us / rewind (checksum {:08X})"_fmt(windowMs, ticks, elapsedUs / Iterations, checksum);
+	}
+	return lines;
+}
+# endif
+
+namespace EventCode {
+	enum : uint8
+	{
+		//イベントコードは1から199までの範囲を使う
+		sendShareGameData = 1,
+		startGame,
+		changePlayerState,
+		finishGame,
+		//5 は以前プレイヤーのデータを送るのに使っていた
+		enemyName = 6,
+		stateHash,
+		requestResync,
+		playerSuspended,
+	};
+}
+
+String VERSION = U"1.4";
+
+//シミュレーションの 1 秒あたりのステップ数。120 などに上げると状態の変化が細かくなる
+//両者で同じ値である必要があるので、既定値以外ではマッチングを分ける (MyClient のコンストラクタ)
+# ifndef CCLEMON_TICK_RATE
+#	define CCLEMON_TICK_RATE 60
+# endif
+constexpr int32 TickRate = CCLEMON_TICK_RATE;
+
+//描画用にプレイヤーのデータを a から b へ t の割合で補間する
+std::array<PlayerData, 2> BlendPlayers(const std::array<PlayerData, 2>& a, const std::array<PlayerData, 2>& b, double t)
+{
+	std::array<PlayerData, 2> result = b;
+	for (size_t i = 0; i < result.size(); ++i) {
+		result[i].hp = Max(0.0, Math::Lerp(a[i].hp, b[i].hp, t));
+		result[i].chargePoint = Max(0.0, Math::Lerp(a[i].chargePoint, b[i].chargePoint, t));
+	}
+	return result;
+}
+
+# if SIV3D_PLATFORM(WEB)
+//選んだ地域をブラウザに保存しておき、次からは測らずに使う
+EM_JS(int32, siv3dLoadCachedRegion, (char* buffer, int32 size, double maxAgeMillisec), {
+	//?photonProbe= で測る先を差し替えているときは毎回測る
+	if (new URLSearchParams(location.search).has("photonProbe")) return 0;
+	try {
+		const cached = JSON.parse(localStorage.getItem("cclemon.region"));
+		if (cached && (typeof cached.region === "string") && ((Date.now() - cached.savedAt) < maxAgeMillisec)) {
+			return stringToUTF8(cached.region, buffer, size);
+		}
+	} catch (e) {
+	}
+	return 0;
+	});
+
+EM_JS(void, siv3dSaveCachedRegion, (const char* region), {
+	try {
+		localStorage.setItem("cclemon.region", JSON.stringify({ region: UTF8ToString(region), savedAt: Date.now() }));
+	} catch (e) {
+	}
+	});
+# endif
+
+//Photon への接続。SDK の読み込みが終わったら 1 回だけつなぎ、失敗したり切れたりしたら間隔を空けてつなぎ直す
+//部屋にいる間に切れたときは、同じ部屋に再参加する
+//地域は候補への接続時間を測って最も速いものを選び、Web ではブラウザに保存して 7 日間使い回す
+class ConnectionManager {
+public:
+	enum class Phase : uint8 {
+		Idle,
+		Probing,
+		Connecting,
+		Connected,
+		WaitingRetry,
+	};
+
+	//測れなかったとき・ネイティブでつなぐ地域
+	static constexpr StringView DefaultRegion = U"jp";
+
+	//1 フレームに 1 回呼ぶ。接続を始められたフレームでは true を返す
+	bool update(Multiplayer_Photon& client, bool sdkLoaded) {
+		const double now = GetInputTimeStamp();
+
+		switch (m_phase) {
+		case Phase::Idle:
+# if SIV3D_PLATFORM(WEB)
+			//SDK の読み込みに失敗したら、つなぎ直すときと同じように間隔を空けて読み込み直す
+			if (client.isSdkLoadFailed()) {
+				++m_failures;
+				m_reloadSdk = true;
+				Logger << U"[connect] failed to load the Photon SDK";
+				scheduleRetry(now);
+				return false;
+			}
+# endif
+			return sdkLoaded and chooseRegion(client, now);
+		case Phase::Probing:
+			if ((m_probes.size() >= m_candidates.size()) or ((now - m_probeStart) >= ProbeTimeoutMillisec)) {
+				finishProbe(client, now);
+				return connect(client, now);
+			}
+			return false;
+		case Phase::Connecting:
+			if (client.isInLobby() or client.isInRoom()) {
+				m_lastConnectMillisec = (now - m_connectStart);
+				m_attempt = 0;
+				m_rejoin = false;
+				m_phase = Phase::Connected;
+				Logger << U"[connect] {} {:.0f}ms, attempts: {}"_fmt(m_region, m_lastConnectMillisec, m_attempts);
+			}
+			else if (client.isDisconnected()) {
+				++m_failures;
+				m_rejoin = false;
+				scheduleRetry(now);
+			}
+			else if ((now - m_connectStart) >= ConnectTimeoutMillisec) {
+				++m_failures;
+				m_rejoin = false;
+				client.disconnect();
+				scheduleRetry(now);
+			}
+			return false;
+		case Phase::Connected:
+			if (client.isDisconnected()) {
+				//部屋にいる間に切れたら、まず再参加の猶予のうちに同じ部屋へ戻る。失敗したら普通につなぎ直す
+				m_rejoin = m_inRoom;
+				scheduleRetry(now);
+			}
+			m_inRoom = client.isInRoom();
+			return false;
+		case Phase::WaitingRetry:
+			if (now < m_retryAt) return false;
+# if SIV3D_PLATFORM(WEB)
+			if (m_reloadSdk) {
+				m_reloadSdk = false;
+				client.reloadSdk();
+				m_phase = Phase::Idle;
+				return false;
+			}
+# endif
+			return connect(client, now);
+		}
+
+		return false;
+	}
+
+	//Multiplayer_Photon::regionProbeReturn() から受け取る。rttMillisec が負なら測れなかった
+	void addProbeResult(const String& region, int32 rttMillisec) {
+		if (m_phase != Phase::Probing) return;
+		m_probes.emplace_back(region, rttMillisec);
+	}
+
+	Phase phase() const noexcept { return m_phase; }
+
+	const String& region() const noexcept { return m_region; }
+
+	bool isRegionFromCache() const noexcept { return m_regionFromCache; }
+
+	//connect() を呼んだ回数と、そのうち失敗した回数
+	int32 attempts() const noexcept { return m_attempts; }
+	int32 failures() const noexcept { return m_failures; }
+
+	//最後につながったときの connect() からロビーに入るまでの時間と、地域を測るのにかかった時間(ミリ秒)
+	double lastConnectMillisec() const noexcept { return m_lastConnectMillisec; }
+	double probeMillisec() const noexcept { return m_probeMillisec; }
+
+	const Array<std::pair<String, int32>>& probes() const noexcept { return m_probes; }
+
+private:
+	static constexpr double ProbeTimeoutMillisec = 3000;
+	static constexpr double ConnectTimeoutMillisec = 15000;
+	static constexpr double RetryBaseMillisec = 1000;
+	static constexpr double RetryMaxMillisec = 30000;
+	static constexpr double RegionCacheMaxAgeMillisec = 7 * 24 * 60 * 60 * 1000.0;
+
+	Array<String> m_candidates = { U"jp", U"kr", U"asia", U"us" };
+	Array<std::pair<String, int32>> m_probes;
+
+	Phase m_phase = Phase::Idle;
+	String m_region{ DefaultRegion };
+	bool m_regionFromCache = false;
+	bool m_inRoom = false;
+	bool m_rejoin = false;
+	bool m_reloadSdk = false;
+
+	int32 m_attempt = 0;
+	int32 m_attempts = 0;
+	int32 m_failures = 0;
+
+	double m_probeStart = 0;
+	double m_connectStart = 0;
+	double m_retryAt = 0;
+	double m_lastConnectMillisec = 0;
+	double m_probeMillisec = 0;
+
+	bool chooseRegion([[maybe_unused]] Multiplayer_Photon& client, double now) {
+# if SIV3D_PLATFORM(WEB)
+		char buffer[32]{};
+		if (siv3dLoadCachedRegion(buffer, sizeof(buffer), RegionCacheMaxAgeMillisec) > 0) {
+			m_region = Unicode::FromUTF8(buffer);
+			m_regionFromCache = true;
+			return connect(client, now);
+		}
+
+		if (client.probeRegions(m_candidates, static_cast<int32>(ProbeTimeoutMillisec))) {
+			m_probeStart = now;
+			m_phase = Phase::Probing;
+			return false;
+		}
+# endif
+		return connect(client, now);
+	}
+
+	void finishProbe([[maybe_unused]] Multiplayer_Photon& client, double now) {
+		m_probeMillisec = (now - m_probeStart);
+
+# if SIV3D_PLATFORM(WEB)
+		//時間切れで選ぶときは、残っている測定の接続を切る
+		client.cancelRegionProbes();
+# endif
+
+		String log = U"[probe]";
+		int32 best = -1;
+		for (const auto& [region, rtt] : m_probes) {
+			log += U" {}={}ms"_fmt(region, rtt);
+			if ((rtt >= 0) and ((best < 0) or (rtt < best))) {
+				best = rtt;
+				m_region = region;
+			}
+		}
+		Logger << log;
+
+# if SIV3D_PLATFORM(WEB)
+		//どこも測れなかったときは保存せず、次の起動でまた測る
+		if (best >= 0) {
+			siv3dSaveCachedRegion(m_region.toUTF8().c_str());
+		}
+# endif
+	}
+
+	//接続を始められたら true を返す。始められなければ間隔を空けてやり直す
+	bool connect(Multiplayer_Photon& client, double now) {
+		++m_attempts;
+		m_connectStart = now;
+
+		if (m_rejoin ? client.reconnectAndRejoin() : client.connect(U"player", m_region)) {
+			m_phase = Phase::Connecting;
+			return true;
+		}
+
+		++m_failures;
+		m_rejoin = false;
+		scheduleRetry(now);
+		return false;
+	}
+
+	//待ち時間は 0 から上限までの一様乱数 (full jitter)。上限は失敗するたびに倍にする
+	//一斉に切れたクライアントがつなぎ直すタイミングをばらけさせる
+	void scheduleRetry(double now) {
+		const double limit = Min(RetryMaxMillisec, RetryBaseMillisec * std::exp2(Min(m_attempt, 16)));
+		m_retryAt = now + Random(0.0, limit);
+		++m_attempt;
+		m_phase = Phase::WaitingRetry;
+	}
+};
+
+class MyClient : public Multiplayer_Photon
+{
+public:
+	MyClient()
+	{
+		init(std::string(SIV3D_OBFUSCATE(PHOTON_APP_ID)), (TickRate == 60) ? VERSION : U"{}-{}Hz"_fmt(VERSION, TickRate), Verbose::No);
+
+		RegisterEventCallback(EventCode::sendShareGameData, &MyClient::eventReceived_sendShareGameData);
+		RegisterEventCallback(EventCode::startGame, &MyClient::eventReceived_startGame);
+		RegisterEventCallback(EventCode::changePlayerState, &MyClient::eventReceived_changePlayerState);
+		RegisterEventCallback(EventCode::finishGame, &MyClient::eventReceived_finishGame);
+		RegisterEventCallback(EventCode::enemyName, &MyClient::eventReceived_enemyName);
+		RegisterEventCallback(EventCode::stateHash, &MyClient::eventReceived_stateHash);
+		RegisterEventCallback(EventCode::requestResync, &MyClient::eventReceived_requestResync);
+		RegisterEventCallback(EventCode::playerSuspended, &MyClient::eventReceived_playerSuspended);
+
+		resetHashHistory();
+
+	}
+
+	Optional<ShareGameData> shareGameData;
+
+	int32 myPlayerIndex = 0;
+
+	String myPlayerName;
+	String enemyPlayerName;
+
+	Timer timer{ 3s };
+
+	//ホストが状態のハッシュを送る間隔(ステップ数)
+	int32 hashSendIntervalTicks = TickRate / 2;
+
+	//検出した同期ずれの回数と、最後に検出したステップ
+	int32 desyncCount = 0;
+	int32 lastDesyncTick = -1;
+
+	//フレームが遅れすぎて進めずに捨てたステップの数と、それで状態を合わせ直した回数
+	int32 droppedTickCount = 0;
+	int32 dropResyncCount = 0;
+
+	//タブを非表示にして中断しているプレイヤー
+	std::array<bool, 2> suspendedPlayers{};
+
+	//復帰した回数と、最後の復帰で表示が戻ってからホストの状態を受け取るまでの時間(ミリ秒)
+	int32 resumeCount = 0;
+	double lastResumeMillisec = 0;
+
+	//接続と地域の選択
+	ConnectionManager connection;
+
+	//試合中に抜けたプレイヤーが同じ部屋に戻れる時間。過ぎても戻らなければ残った側の勝ち
+	static constexpr Milliseconds RejoinGracePeriod = 15s;
+
+	//ホストを引き継いだ回数と、最後の引き継ぎで前のホストから最後に受信してから引き継いだ状態で進め始めるまでの時間(ミリ秒)
+	//引き継いだ状態まで戻したステップ数
+	int32 handoffCount = 0;
+	double lastHandoffMillisec = 0;
+	int32 lastHandoffRewindTicks = 0;
+
+	//タブが非表示になったときに呼ぶ。押していたボタンを離したことにして、相手に中断を知らせる
+	void suspend()
+	{
+		if (not shareGameData or shareGameData->gameState != GameState::Playing) return;
+
+		requestState(PlayerState::Charge, GetInputTimeStamp());
+		//このあとステップが進まないので、溜めずに送る
+		flushStateChange();
+		sendEvent({ EventCode::playerSuspended, ReceiverOption::Others }, myPlayerIndex, true);
+	}
+
+	//タブが戻ったときに呼ぶ。止まっていた間は再シミュレーションせず、ホスト以外はホストの状態をもらい直す
+	//shownAt は表示が戻った時刻(GetInputTimeStamp と同じ基準)
+	void resume(double shownAt)
+	{
+		if (not shareGameData or shareGameData->gameState != GameState::Playing) return;
+
+		++resumeCount;
+		sendEvent({ EventCode::playerSuspended, ReceiverOption::Others }, myPlayerIndex, false);
+
+		if (isHost()) {
+			//ホストの状態が正なので、止まったところから続ける
+			lastResumeMillisec = GetInputTimeStamp() - shownAt;
+			return;
+		}
+
+		m_resumeStart = shownAt;
+		sendEvent({ EventCode::requestResync, ReceiverOption::Host });
+	}
+
+	//追いつく上限を超えて count ステップ分を捨てたときに呼ぶ。捨てた側だけステップが遅れるので、ホストの状態に合わせ直す
+	//ホスト以外はホストに状態を送り直してもらい、ホストは自分の状態を相手に送って戻してもらう
+	void dropTicks(int32 count)
+	{
+		if (not shareGameData or shareGameData->gameState != GameState::Playing) return;
+		if (count <= 0) return;
+
+		droppedTickCount += count;
+		Logger << U"[drop] {} ticks, tick: {}"_fmt(count, shareGameData->tick);
+
+		if (isHost()) {
+			++dropResyncCount;
+			sendEvent({ EventCode::sendShareGameData, ReceiverOption::Others }, *shareGameData);
+		}
+		else if (not m_resyncRequested) {
+			++dropResyncCount;
+			m_resyncRequested = true;
+			sendEvent({ EventCode::requestResync, ReceiverOption::Host });
+		}
+	}
+
+	//ホストが中断している間、ホスト以外はシミュレーションを止めて待つ
+	bool isWaitingForHost() const
+	{
+		return shareGameData and (not isHost()) and suspendedPlayers[1 - myPlayerIndex];
+	}
+
+	//相手が試合中に部屋から抜け、戻ってくるのを待っている間はシミュレーションを止める
+	bool isWaitingForOpponent() const
+	{
+		return (m_opponentReturnDeadline > 0);
+	}
+
+	//毎フレーム呼ぶ。相手が戻らないまま猶予が過ぎたら、ホストが残った側の勝ちで試合を終える
+	//ホストが抜けた場合は、引き継いだ新しいホストが終える
+	void updateOpponentWait()
+	{
+		if (not isWaitingForOpponent()) return;
+
+		if (not shareGameData or shareGameData->gameState != GameState::Playing) {
+			m_opponentReturnDeadline = 0;
+			return;
+		}
+
+		if (isHost() and GetInputTimeStamp() >= m_opponentReturnDeadline) {
+			m_opponentReturnDeadline = 0;
+			Logger << U"[forfeit] tick: {}"_fmt(shareGameData->tick);
+			finishGame(myPlayerIndex);
+		}
+	}
+
+	void startGame(double maxHp, double maxChargePoint)
+	{
+		//ゲーム開始
+		if (not shareGameData) return;
+		shareGameData->maxHp = maxHp;
+		shareGameData->maxChargePoint = maxChargePoint;
+		sendEvent({ EventCode::startGame ,ReceiverOption::All }, maxHp, maxChargePoint);
+	}
+
+	//状態を変更する。timeStamp はその入力があった時刻(GetInputTimeStamp と同じ基準)
+	//tick は反映するステップ。timeStamp は入力があった時刻
+	void changeState(PlayerState state, double timeStamp, int32 tick)
+	{
+		if (not shareGameData) return;
+		//自分は tick で反映する。相手にもそのステップと、押した時刻をサーバ時刻に直したものを送り、同じステップで反映してもらう
+		const int32 age = static_cast<int32>(Max(0.0, GetInputTimeStamp() - timeStamp));
+		sendEvent({ EventCode::changePlayerState, ReceiverOption::Others }, myPlayerIndex, state, getServerTimeMillisec() - age, ++m_stateSequence, tick);
+		applyChange(tick, myPlayerIndex, state, m_stateSequence);
+	}
+
+	void finishGame(int32 wonPlayer)
+	{
+		//ゲーム終了
+		if (not shareGameData) return;
+		sendEvent({ EventCode::finishGame ,ReceiverOption::All }, wonPlayer);
+	}
+
+	//入力で決まった状態を要求する。timeStamp はその入力があった時刻(GetInputTimeStamp と同じ基準)
+	//その時刻のステップにまだ送っていなければすぐ送る。送ってあれば次のステップまで溜め、stepGame でまとめて送る
+	//1 ステップの間に押して離すような揺れは送らずに捨てる
+	void requestState(PlayerState state, double timeStamp)
+	{
+		if (state == m_requestedState) return;
+		m_requestedState = state;
+		m_requestedTimeStamp = timeStamp;
+		++m_pendingToggles;
+
+		if (shareGameData and m_lastStateSendTick < tickAt(timeStamp)) {
+			flushStateChange();
+		}
+	}
+
+	//送信した状態変更の数と、まとめて捨てた切り替えの数
+	int32 sentStateChangeCount = 0;
+	int32 suppressedToggleCount = 0;
+
+	//ホストが遅れて届いた状態変更を巻き戻して適用する範囲(秒)。最大 0.5 秒
+	double rewindWindow = 0.2;
+
+	//巻き戻しや状態のもらい直しでゲージが飛んだとき、描画を前の表示から追いつかせる時間(秒)。0 なら飛んだまま描く
+	double correctionSmoothing = 0.1;
+
+	//シミュレーションを1ステップ進める。tickTimeStamp はこのステップが表す時刻
+	//遅れて届いた変更を巻き戻して適用できるように、進める前の状態を記録する
+	Optional<int32> stepGame(double dt, double tickTimeStamp)
+	{
+		if (not shareGameData) return none;
+
+		//溜めておいた状態変更はこれから進めるステップで反映する
+		flushStateChange();
+		applyLoggedChanges(*shareGameData, shareGameData->tick + 1);
+		m_lastTickTimeStamp = tickTimeStamp;
+
+		if (shareGameData->gameState == GameState::Playing) {
+			m_history.push_back({ shareGameData->tick + 1, dt, *shareGameData });
+
+			while (m_history.size() > MaxRewindTicks) {
+				m_history.pop_front();
+			}
+			m_changeLog.remove_if([oldest = m_history.front().tick](const StateChange& change) { return change.tick < oldest; });
+		}
+
+		m_previousPlayers = shareGameData->players;
+		auto result = shareGameData->updateGame(dt);
+		onTick();
+		return result;
+	}
+
+	//シミュレーションを1ステップ進めた後に呼ぶ。ハッシュを記録し、ホストは定期的に送信する
+	void onTick()
+	{
+		if (not shareGameData) return;
+
+		recordTick(*shareGameData);
+		const int32 tick = shareGameData->tick;
+
+		if (isHost()) {
+			//送るのは巻き戻しでもう変わらないステップのハッシュ。それより新しいステップは相手の変更が届くと変わりうる
+			const int32 settledTick = tick - settleTicks();
+			if ((settledTick > 0) and (settledTick % hashSendIntervalTicks == 0)) {
+				const auto& [recordedTick, recordedHash] = m_hashHistory[settledTick % m_hashHistory.size()];
+				if (recordedTick == settledTick) {
+					sendEvent({ EventCode::stateHash }, settledTick, recordedHash);
+					confirm(settledTick);
+				}
+			}
+		}
+		else if (m_pendingHash and m_pendingHash->first <= tick) {
+			//先に届いていたホストのハッシュにこちらが追いついた
+			const auto [hostTick, hostHash] = *m_pendingHash;
+			m_pendingHash.reset();
+			compareHash(hostTick, hostHash);
+		}
+	}
+
+	//描画用のプレイヤーのデータ。alpha は直前のステップから次のステップまでの経過の割合
+	//ホストも相手も同じステップで同じ変更を反映してシミュレーションしているので、どちらも自分の直前の 2 ステップの間を補間する
+	//巻き戻しなどで飛んだ直後は、飛ぶ前に描いていた値からそこへ correctionSmoothing 秒かけて寄せる
+	std::array<PlayerData, 2> getDisplayPlayers(double alpha)
+	{
+		if (not shareGameData) return {};
+
+		auto players = BlendPlayers(m_previousPlayers, shareGameData->players, Clamp(alpha, 0.0, 1.0));
+
+		if (m_correctionFrom) {
+			const double t = (correctionSmoothing > 0) ? ((GetInputTimeStamp() - m_correctionStart) / (correctionSmoothing * 1000)) : 1.0;
+			if (t < 1.0) {
+				players = BlendPlayers(*m_correctionFrom, players, t);
+			}
+			else {
+				m_correctionFrom.reset();
+			}
+		}
+
+		m_lastDisplayPlayers = players;
+		return players;
+	}
+
+private:
+
+	//直前のステップを進める前のプレイヤーのデータ(描画の補間用)
+	std::array<PlayerData, 2> m_previousPlayers;
+
+	//最後に描いたプレイヤーのデータと、飛んだときに寄せ始める値・時刻
+	Optional<std::array<PlayerData, 2>> m_lastDisplayPlayers;
+	Optional<std::array<PlayerData, 2>> m_correctionFrom;
+	double m_correctionStart = 0;
+
+	//シミュレーションの状態が描画と関係なく置き換わる前に呼ぶ。いま描いている値から寄せ始める
+	void beginCorrection()
+	{
+		if (not m_lastDisplayPlayers) return;
+
+		m_correctionFrom = m_lastDisplayPlayers;
+		m_correctionStart = GetInputTimeStamp();
+	}
+
+	PlayerState m_sentState = PlayerState::Charge;
+
+	//まだ送っていない状態の要求と、その間の切り替え回数
+	PlayerState m_requestedState = PlayerState::Charge;
+	double m_requestedTimeStamp = 0;
+	int32 m_pendingToggles = 0;
+
+	//最後に送った状態変更を反映するステップ
+	int32 m_lastStateSendTick = -1;
+
+	//最後に進めたステップが表す時刻
+	double m_lastTickTimeStamp = 0;
+
+	//状態変更の順序番号。古いものが後から届いたら捨てる
+	uint32 m_stateSequence = 0;
+	std::array<uint32, 2> m_receivedStateSequence{};
+
+	void resetStateRequest()
+	{
+		m_sentState = PlayerState::Charge;
+		m_requestedState = PlayerState::Charge;
+		m_requestedTimeStamp = 0;
+		m_pendingToggles = 0;
+		m_lastStateSendTick = -1;
+		m_lastTickTimeStamp = GetInputTimeStamp();
+		m_stateSequence = 0;
+		m_receivedStateSequence.fill(0);
+	}
+
+	//溜めておいた状態の要求を送る。反映するステップは前に送ったものより後にして、送る順とステップの順をそろえる
+	void flushStateChange()
+	{
+		if (not shareGameData) return;
+		if (m_pendingToggles == 0) return;
+
+		if (m_requestedState != m_sentState) {
+			const int32 tick = Max(tickAt(m_requestedTimeStamp), m_lastStateSendTick + 1);
+			changeState(m_requestedState, m_requestedTimeStamp, tick);
+			m_sentState = m_requestedState;
+			m_lastStateSendTick = tick;
+			++sentStateChangeCount;
+			suppressedToggleCount += m_pendingToggles - 1;
+		}
+		else {
+			suppressedToggleCount += m_pendingToggles;
+		}
+		m_pendingToggles = 0;
+	}
+
+	//timeStamp の入力を反映するステップ。その時刻以降を表す最初のステップで、まだ進めていないもの
+	int32 tickAt(double timeStamp) const
+	{
+		const double stepMillisec = 1000.0 / TickRate;
+		const int32 ahead = static_cast<int32>(Math::Ceil((timeStamp - m_lastTickTimeStamp) / stepMillisec));
+		return shareGameData->tick + Max(ahead, 1);
+	}
+
+	//直近のステップのハッシュ (tick, hash)
+	std::array<std::pair<int32, uint32>, 128> m_hashHistory;
+
+	//自分がまだ到達していないステップのホストのハッシュ
+	Optional<std::pair<int32, uint32>> m_pendingHash;
+
+	bool m_resyncRequested = false;
+
+	//復帰してホストの状態を待っている間、表示が戻った時刻。待っていなければ 0
+	double m_resumeStart = 0;
+
+	//ホストと一致を確認できた最後の状態。ホストが抜けたら、新しいホストはここから続ける
+	Optional<ShareGameData> m_confirmed;
+
+	//ハッシュを送るステップの状態。ホストのハッシュが届くまで確定しない
+	std::array<Optional<ShareGameData>, 4> m_confirmCandidates;
+
+	//ホストから最後にイベントを受信した時刻
+	double m_lastHostMessageAt = 0;
+
+	//抜けた相手が戻ってくる期限。待っていなければ 0
+	double m_opponentReturnDeadline = 0;
+
+	//前のホストが抜けて自分がホストになったとき、最後に確定した状態から自分がホストとして進め直す
+	//相手が残っていれば(ホストだけが移ったとき)その状態を送り、相手もそこから続ける
+	void takeOverHost()
+	{
+		const double now = GetInputTimeStamp();
+
+		lastHandoffRewindTicks = shareGameData->tick - m_confirmed->tick;
+		lastHandoffMillisec = (m_lastHostMessageAt > 0) ? (now - m_lastHostMessageAt) : 0;
+		++handoffCount;
+
+		beginCorrection();
+		shareGameData = *m_confirmed;
+		//自分の状態は、確定した後に送った変更も含めて最新にする
+		shareGameData->players[myPlayerIndex].state = m_sentState;
+		m_previousPlayers = shareGameData->players;
+
+		resetHashHistory();
+		resetRewindHistory();
+
+		sendEvent({ EventCode::sendShareGameData, ReceiverOption::Others }, *shareGameData);
+
+		Logger << U"[handoff] {:.1f}ms, tick: {}, rewind: {} ticks"_fmt(lastHandoffMillisec, shareGameData->tick, lastHandoffRewindTicks);
+	}
+
+	//巻き戻し用の履歴。巻き戻す範囲の最大 0.5 秒を少し超える分
+	static constexpr size_t MaxRewindTicks = (TickRate * 2 / 3);
+
+	struct TickRecord
+	{
+		int32 tick; //このステップで進めた後の tick
+		double dt;
+		ShareGameData before; //このステップの状態変更を反映済み、進める前の状態
+	};
+
+	struct StateChange
+	{
+		int32 tick; //反映されるステップ
+		int32 playerIndex;
+		PlayerState state;
+		uint32 sequence;
+	};
+
+	Array<TickRecord> m_history;
+
+	Array<StateChange> m_changeLog;
+
+	//ホストがプレイヤーごとに最後に変更を反映したステップ。後から届いた変更をそれより前には入れない
+	std::array<int32, 2> m_lastChangeTick{};
+
+	void resetRewindHistory()
+	{
+		m_history.clear();
+		m_changeLog.clear();
+		m_lastChangeTick.fill(0);
+	}
+
+	//ホストが巻き戻しを受け付けるステップ数。これより前のステップはハッシュを送っていて、もう変えない
+	int32 settleTicks() const
+	{
+		return static_cast<int32>(Math::Ceil(rewindWindow * TickRate)) + 1;
+	}
+
+	//tick のステップで反映する変更をすべて data に反映する
+	void applyLoggedChanges(ShareGameData& data, int32 tick) const
+	{
+		for (const auto& change : m_changeLog) {
+			if (change.tick == tick) {
+				data.players[change.playerIndex].state = change.state;
+			}
+		}
+	}
+
+	//ステップを進めた状態のハッシュを記録する。ハッシュを送るステップの状態は、ホストのハッシュと一致したらホストの交代で引き継ぐ状態にする
+	void recordTick(const ShareGameData& data)
+	{
+		m_hashHistory[data.tick % m_hashHistory.size()] = { data.tick, data.hash() };
+
+		if (data.tick % hashSendIntervalTicks == 0) {
+			m_confirmCandidates[(data.tick / hashSendIntervalTicks) % m_confirmCandidates.size()] = data;
+		}
+	}
+
+	void confirm(int32 tick)
+	{
+		const auto& candidate = m_confirmCandidates[(tick / hashSendIntervalTicks) % m_confirmCandidates.size()];
+		if (candidate and candidate->tick == tick) {
+			m_confirmed = candidate;
+		}
+	}
+
+	//tick のステップで状態変更を反映する。まだ進めていないステップならそのときに、もう進めたステップなら巻き戻して進め直す
+	//履歴に残っていないほど古いステップは次のステップに回す。反映するステップを返す
+	int32 applyChange(int32 tick, int32 playerIndex, PlayerState state, uint32 sequence)
+	{
+		auto it = std::find_if(m_history.begin(), m_history.end(), [&](const TickRecord& record) { return record.tick == tick; });
+
+		if (tick <= shareGameData->tick and it == m_history.end()) {
+			tick = shareGameData->tick + 1;
+		}
+
+		m_changeLog.push_back({ tick, playerIndex, state, sequence });
+
+		if (tick <= shareGameData->tick) {
+			replayFrom(it);
+		}
+		return tick;
+	}
+
+	//ホストが別のステップに移した自分の変更を、そのステップに移して進め直す
+	//もう記録に残っていなければ何もしない(ずれはハッシュの不一致から送り直しで直る)
+	void moveChange(uint32 sequence, int32 tick)
+	{
+		auto change = std::find_if(m_changeLog.begin(), m_changeLog.end(), [&](const StateChange& c) { return (c.playerIndex == myPlayerIndex) and (c.sequence == sequence); });
+		if (change == m_changeLog.end()) return;
+
+		const int32 from = Min(change->tick, tick);
+		change->tick = tick;
+
+		if (from <= shareGameData->tick) {
+			auto it = std::find_if(m_history.begin(), m_history.end(), [&](const TickRecord& record) { return record.tick == from; });
+			if (it != m_history.end()) {
+				replayFrom(it);
+			}
+		}
+	}
+
+	//it のステップから現在まで、記録した変更を反映し直して再シミュレーションする
+	void replayFrom(Array<TickRecord>::iterator it)
+	{
+		ShareGameData replayed = it->before;
+
+		Optional<int32> result;
+		for (auto record = it; record != m_history.end(); ++record) {
+			applyLoggedChanges(replayed, record->tick);
+			record->before = replayed;
+
+			result = replayed.updateGame(record->dt);
+			recordTick(replayed);
+
+			if (result) break;
+		}
+
+		beginCorrection();
+		shareGameData->players = replayed.players;
+
+		//勝敗はホストが決める
+		if (result and isHost()) {
+			finishGame(result.value());
+		}
+	}
+
+	//遅れて届いた相手の状態変更を、相手が反映したステップに戻して適用する
+	//送信時刻か反映するステップが古すぎるものは次のステップで反映し、反映したステップだけを送り主に知らせて合わせてもらう
+	void rewindAndApply(LocalPlayerID playerID, int32 playerIndex, PlayerState state, int32 serverTime, uint32 sequence, int32 tick)
+	{
+		const int32 age = getServerTimeMillisec() - serverTime;
+		const bool inWindow = (age <= rewindWindow * 1000) and (tick > shareGameData->tick - settleTicks());
+
+		//同じプレイヤーの変更は送った順に反映する
+		const int32 target = Max(inWindow ? tick : (shareGameData->tick + 1), m_lastChangeTick[playerIndex]);
+		const int32 applied = applyChange(target, playerIndex, state, sequence);
+		m_lastChangeTick[playerIndex] = applied;
+
+		if (applied != tick) {
+			sendEvent({ EventCode::changePlayerState, { playerID } }, playerIndex, state, serverTime, sequence, applied);
+		}
+	}
+
+	void resetHashHistory()
+	{
+		m_hashHistory.fill({ -1, 0 });
+		m_confirmCandidates.fill(none);
+		m_pendingHash.reset();
+		m_resyncRequested = false;
+	}
+
+	void compareHash(int32 tick, uint32 hash)
+	{
+		const auto& [recordedTick, recordedHash] = m_hashHistory[tick % m_hashHistory.size()];
+		if (recordedTick != tick) return; //古すぎて履歴に残っていない
+		if (recordedHash == hash) {
+			confirm(tick);
+			return;
+		}
+
+		++desyncCount;
+		lastDesyncTick = tick;
+		Logger << U"[desync] tick: {}, count: {}"_fmt(tick, desyncCount);
+
+		//ずれていたときだけ全体を送り直してもらう
+		if (not m_resyncRequested) {
+			m_resyncRequested = true;
+			sendEvent({ EventCode::requestResync, ReceiverOption::Host });
+		}
+	}
+
+	//イベントを受信したらそれに応じた処理を行う
+
+	void eventReceived_sendShareGameData([[maybe_unused]] LocalPlayerID playerID, const ShareGameData& data)
+	{
+		if (data.gameState == GameState::Playing) {
+			beginCorrection();
+		}
+		else {
+			m_lastDisplayPlayers.reset();
+			m_correctionFrom.reset();
+		}
+		shareGameData = data;
+		m_confirmed = data;
+		m_lastHostMessageAt = GetInputTimeStamp();
+		m_previousPlayers = data.players;
+		resetHashHistory();
+		resetRewindHistory();
+
+		if (m_resumeStart > 0) {
+			lastResumeMillisec = GetInputTimeStamp() - m_resumeStart;
+			m_resumeStart = 0;
+			Logger << U"[resume] {:.1f}ms, tick: {}"_fmt(lastResumeMillisec, shareGameData->tick);
+		}
+	}
+
+	void eventReceived_startGame([[maybe_unused]] LocalPlayerID playerID, double maxHp, double maxChargePoint)
+	{
+		if (not shareGameData) return;
+		shareGameData->maxHp = maxHp;
+		shareGameData->maxChargePoint = maxChargePoint;
+		shareGameData->gameState = GameState::Playing;
+		shareGameData->players = { PlayerData(maxHp, 0), PlayerData(maxHp, 0) };
+		m_previousPlayers = shareGameData->players;
+		m_lastDisplayPlayers.reset();
+		m_correctionFrom.reset();
+		if (playerID == getLocalPlayerID()) {
+			myPlayerIndex = 0;
+		}
+		else {
+			myPlayerIndex = 1;
+		}
+		shareGameData->tick = 0;
+		suspendedPlayers.fill(false);
+		resetHashHistory();
+		resetRewindHistory();
+		resetStateRequest();
+		m_confirmed = shareGameData;
+		m_lastHostMessageAt = GetInputTimeStamp();
+		m_opponentReturnDeadline = 0;
+		timer.restart();
+	}
+
+	void eventReceived_changePlayerState([[maybe_unused]] LocalPlayerID playerID, int32 playerIndex, PlayerState state, int32 serverTime, uint32 sequence, int32 tick)
+	{
+		if (not shareGameData) return;
+
+		if (sequence <= m_receivedStateSequence[playerIndex]) return;
+		m_receivedStateSequence[playerIndex] = sequence;
+
+		if (shareGameData->gameState != GameState::Playing) {
+			shareGameData->players[playerIndex].state = state;
+			return;
+		}
+
+		if (isHost()) {
+			rewindAndApply(playerID, playerIndex, state, serverTime, sequence, tick);
+			return;
+		}
+
+		//ホスト以外は、ホストが反映したステップで反映する。自分の変更が届くのは、ホストが別のステップに移したとき
+		m_lastHostMessageAt = GetInputTimeStamp();
+		if (playerIndex == myPlayerIndex) {
+			moveChange(sequence, tick);
+		}
+		else {
+			applyChange(tick, playerIndex, state, sequence);
+		}
+	}
+
+	void eventReceived_finishGame([[maybe_unused]] LocalPlayerID playerID, int32 wonPlayer)
+	{
+		if (not shareGameData) return;
+		shareGameData->wonPlayer = wonPlayer;
+		shareGameData->gameState = GameState::Finished;
+	}
+
+	void eventReceived_enemyName([[maybe_unused]] LocalPlayerID playerID, const String& name)
+	{
+		enemyPlayerName = name;
+	}
+
+	void eventReceived_stateHash([[maybe_unused]] LocalPlayerID playerID, int32 tick, uint32 hash)
+	{
+		if (not shareGameData) return;
+
+		m_lastHostMessageAt = GetInputTimeStamp();
+
+		if (tick > shareGameData->tick) {
+			m_pendingHash = std::pair{ tick, hash };
+		}
+		else {
+			compareHash(tick, hash);
+		}
+	}
+
+	void eventReceived_requestResync(LocalPlayerID playerID)
+	{
+		//ホストは要求してきたプレイヤーに現在の状態を丸ごと送る
+		if (not shareGameData or not isHost()) return;
+		sendEvent({ EventCode::sendShareGameData, { playerID } }, *shareGameData);
+	}
+
+	void eventReceived_playerSuspended([[maybe_unused]] LocalPlayerID playerID, int32 playerIndex, bool suspended)
+	{
+		suspendedPlayers[playerIndex] = suspended;
+	}
+
+
+	void joinRoomEventAction(const LocalPlayer& newPlayer, [[maybe_unused]] const Array<LocalPlayerID>& playerIDs, bool isSelf) override
+	{
+		//自分が部屋に入った時
+		if (isSelf) {
+			shareGameData.reset();
+			sendEvent({ EventCode::enemyName, ReceiverOption::Others }, myPlayerName);
+		}
+		else {
+			sendEvent({ EventCode::enemyName ,{newPlayer.localID} }, myPlayerName);
+		}
+
+		//ホストが入室した時、つまり部屋を新規作成した時
+		if (isSelf and isHost()) {
+			shareGameData = ShareGameData();
+		}
+
+		//誰かが部屋に入って来た時、ホストはその人にデータを送る
+		//試合中に抜けた相手が戻ってきたときは、その時点の状態から続けてもらう
+		if (not isSelf and isHost()) {
+			sendEvent({ EventCode::sendShareGameData, { newPlayer.localID } }, *shareGameData);
+		}
+		if (not isSelf) {
+			m_opponentReturnDeadline = 0;
+		}
+	}
+
+	void leaveRoomEventAction(LocalPlayerID playerID, bool isInactive) {
+		enemyPlayerName = U"";
+		suspendedPlayers.fill(false);
+
+		//試合中に相手が抜けたら止めて待つ。接続が切れただけなら再参加の猶予の間、退出したならすぐに終える
+		if (shareGameData and shareGameData->gameState == GameState::Playing and playerID != getLocalPlayerID()) {
+			m_opponentReturnDeadline = GetInputTimeStamp() + (isInactive ? RejoinGracePeriod.count() : 0);
+		}
+	}
+
+	//ホストが抜けると、Photon が残ったプレイヤーを新しいホストにする
+	void onHostChange(LocalPlayerID newHostPlayerID, [[maybe_unused]] LocalPlayerID oldHostPlayerID) override
+	{
+		if (newHostPlayerID != getLocalPlayerID()) return;
+		if (not shareGameData or shareGameData->gameState != GameState::Playing or not m_confirmed) return;
+
+		takeOverHost();
+	}
+
+	void leaveRoomReturn(int32 errorCode, const String& errorString) {
+		enemyPlayerName = U"";
+	}
+
+# if SIV3D_PLATFORM(WEB)
+	void regionProbeReturn(const String& region, int32 rttMillisec) override {
+		connection.addProbeResult(region, rttMillisec);
+	}
+
+	//Multiplayer_Photon の処理をトレースに記録する。イベントの受信と送信は、メモリ確保もそれぞれの箇所に計上する
+	void onProcessBegin(PhotonProcess process, int32 arg0, int32 arg1) override
+	{
+		TraceRecorder::Begin(PhotonTraceTypes[static_cast<size_t>(process)], arg0, arg1);
+
+		if (process == PhotonProcess::CustomEvent) {
+			static AllocationSite allocationSite{ U"customEventAction" };
+			m_receiveAllocation.emplace(allocationSite);
+		}
+		else if (process == PhotonProcess::SendEvent) {
+			static AllocationSite allocationSite{ U"sendEvent" };
+			m_sendAllocation.emplace(allocationSite);
+		}
+	}
+
+	void onProcessEnd(PhotonProcess process) override
+	{
+		if (process == PhotonProcess::CustomEvent) {
+			m_receiveAllocation.reset();
+		}
+		else if (process == PhotonProcess::SendEvent) {
+			m_sendAllocation.reset();
+		}
+
+		TraceRecorder::End(PhotonTraceTypes[static_cast<size_t>(process)]);
+	}
+
+	static constexpr std::array<TraceEventType, static_cast<size_t>(PhotonProcess::Count)> PhotonTraceTypes = { {
+		{ U"siv3dPhotonGeneralCallback", U"photon", U"callback", U"errorCode" },
+		{ U"siv3dPhotonClientStateChangeCallback", U"photon", U"state" },
+		{ U"siv3dPhotonAppStateChangeCallback", U"photon" },
+		{ U"siv3dPhotonActorJoinCallback", U"photon", U"playerID" },
+		{ U"siv3dPhotonActorLeaveCallback", U"photon", U"playerID" },
+		{ U"siv3dPhotonCustomEventCallback", U"photon", U"playerID", U"code" },
+		{ U"customEventAction", U"photon", U"code", U"size" },
+		{ U"sendEvent", U"photon", U"code", U"size" },
+		{ U"siv3dPhotonOnRoomListUpdateCallback", U"photon" },
+		{ U"siv3dPhotonOnRoomPropertiesChangeCallback", U"photon" },
+		{ U"siv3dPhotonOnHostChangeCallback", U"photon", U"newHost", U"oldHost" },
+		{ U"siv3dPhotonPumpCallback", U"photon" },
+		{ U"siv3dPhotonRegionProbeCallback", U"photon", U"rttMillisec" },
+	} };
+
+	//イベントを受信・送信している間、メモリ確保をその箇所に計上する
+	Optional<AllocationScope> m_receiveAllocation;
+	Optional<AllocationScope> m_sendAllocation;
+# endif
+};
+
+//ビルド時に作ったアイコンのアトラス (tools/build_icon_atlas.py) からアイコンを取り出す
+//アトラスに無いアイコンは、これまで通りアイコンフォントからその場で作る
+class IconAtlas {
+public:
+	explicit IconAtlas(FilePathView manifestPath) {
+		//アトラスが無いと Web のリリースビルドではアイコンを作れない (フォントを含めていない) ので、起動時に止める
+		const JSON manifest = JSON::Load(manifestPath);
+		if (not manifest) {
+			throw Error{ U"IconAtlas: failed to load {} (run tools/build_icon_atlas.py)"_fmt(manifestPath) };
+		}
+
+		//Texture{ path } は Web ではブラウザのデコード (ASYNCIFY が要る) を通るので、libpng で同期的に読む (ReleaseNoAsyncify)
+		m_texture = Texture{ PNGDecoder{}.decode(FileSystem::ParentPath(manifestPath) + manifest[U"texture"].getString()) };
+		if (not m_texture) {
+			throw Error{ U"IconAtlas: failed to load {}"_fmt(manifest[U"texture"].getString()) };
+		}
+
+		for (const auto& icon : manifest[U"icons"].arrayView()) {
+			const auto& rect = icon[U"rect"];
+			m_regions.emplace(Key(icon[U"code"].get<uint32>(), icon[U"size"].get<int32>()),
+				m_texture(rect[0].get<int32>(), rect[1].get<int32>(), rect[2].get<int32>(), rect[3].get<int32>()));
+		}
+	}
+
+	TextureRegion get(uint32 code, int32 size) {
+		if (auto it = m_regions.find(Key(code, size)); it != m_regions.end()) {
+			return it->second;
+		}
+
+		//アトラスに無いアイコンはフォントから作る。フォントを含めているデバッグビルドでしか作れないので、アトラスに足すよう知らせる
+		Logger << U"[icon] 0x{:X} ({}px) is not in the atlas; add it to ICONS in tools/build_icon_atlas.py"_fmt(code, size);
+		Texture texture{ Icon{ code }, size };
+		if (not texture) {
+			throw Error{ U"IconAtlas: icon 0x{:X} ({}px) is not in the atlas"_fmt(code, size) };
+		}
+		m_fallbacks << texture;
+		return m_regions.emplace(Key(code, size), texture(0, 0, texture.width(), texture.height())).first->second;
+	}
+
+	//アトラスに無くてフォントから作ったアイコンの数
+	size_t fallbackCount() const noexcept { return m_fallbacks.size(); }
+
+private:
+	Texture m_texture;
+	HashTable<uint64, TextureRegion> m_regions;
+	Array<Texture> m_fallbacks;
+
+	static uint64 Key(uint32 code, int32 size) noexcept {
+		return ((static_cast<uint64>(code) << 32) | static_cast<uint32>(size));
+	}
+};
+
+//プレイ画面のゲージ・ボタンの状態を定数バッファにまとめ、それらを囲む四角形 1 枚をシェーダで描く
+//シェーダが使えない環境では図形を 1 つずつ描く
+class HUDRenderer {
+public:
+	struct Layout {
+		Circle enemyCircle;
+		Circle chargeCircle;
+		RectF enemyHpBar;
+		RectF hpBar;
+		RectF attackButton;
+		RectF defenseButton;
+	};
+
+	//false にするとシェーダが使えても図形を 1 つずつ描く。F7 で切り替える(描画回数・処理時間の比較用)
+	bool useShader = true;
+
+	explicit HUDRenderer(const Layout& layout)
+		: m_layout(layout)
+		, m_bounds(Bounds(layout))
+		, m_shader(ESSL{ U"resources/shader/essl/hud.frag", { { U"PSConstants2D", 0 }, { U"HUD", 1 } } })
+		, m_base(Image{ 1, 1, Palette::White }) {}
+
+	bool isShaderAvailable() const noexcept { return static_cast<bool>(m_shader); }
+
+	bool isShaderActive() const noexcept { return (m_shader and useShader); }
+
+	void draw(const PlayerData& player, const PlayerData& enemy, double maxHp, double maxChargePoint) {
+		if (not isShaderActive()) {
+			drawShapes(player, enemy, maxHp, maxChargePoint);
+			return;
+		}
+
+		const auto toFloat4 = [](const RectF& rect) { return Float4(rect.x, rect.y, rect.w, rect.h); };
+
+		m_constants->bounds = toFloat4(m_bounds);
+		m_constants->enemyCircle = Float4(m_layout.enemyCircle.x, m_layout.enemyCircle.y, m_layout.enemyCircle.r, enemy.chargePoint / maxChargePoint);
+		m_constants->chargeCircle = Float4(m_layout.chargeCircle.x, m_layout.chargeCircle.y, m_layout.chargeCircle.r, player.chargePoint / maxChargePoint);
+		m_constants->enemyHpBar = toFloat4(m_layout.enemyHpBar);
+		m_constants->hpBar = toFloat4(m_layout.hpBar);
+		m_constants->attackButton = toFloat4(m_layout.attackButton);
+		m_constants->defenseButton = toFloat4(m_layout.defenseButton);
+		m_constants->values = Float4(enemy.hp / maxHp, player.hp / maxHp, static_cast<int32>(enemy.state), static_cast<int32>(player.state));
+
+		Graphics2D::SetPSConstantBuffer(1, m_constants);
+		const ScopedCustomShader2D shader{ m_shader };
+		m_base.resized(m_bounds.size).draw(m_bounds.pos);
 	}
-};
 
-namespace EventCode {
-	enum : uint8
-	{
-		//イベントコードは1から199までの範囲を使う
-		sendShareGameData = 1,
-		startGame,
-		changePlayerState,
-		finishGame,
-		players,
-		enemyName,
+private:
+	struct Constants {
+		Float4 bounds;
+		Float4 enemyCircle;
+		Float4 chargeCircle;
+		Float4 enemyHpBar;
+		Float4 hpBar;
+		Float4 attackButton;
+		Float4 defenseButton;
+		Float4 values;
 	};
-}
 
-String VERSION = U"1.3";
+	Layout m_layout;
+	RectF m_bounds;
+	PixelShader m_shader;
+	Texture m_base;
+	ConstantBuffer<Constants> m_constants;
+
+	//シェーダで描く範囲。円の周りの輪とアンチエイリアスの分も含める
+	static RectF Bounds(const Layout& layout) {
+		const std::array<RectF, 6> rects = {
+			layout.enemyCircle.stretched(10).boundingRect(), layout.chargeCircle.stretched(10).boundingRect(),
+			layout.enemyHpBar, layout.hpBar, layout.attackButton, layout.defenseButton,
+		};
+
+		Vec2 tl = rects[0].tl();
+		Vec2 br = rects[0].br();
+		for (const auto& rect : rects) {
+			tl = Vec2{ Min(tl.x, rect.x), Min(tl.y, rect.y) };
+			br = Vec2{ Max(br.x, rect.x + rect.w), Max(br.y, rect.y + rect.h) };
+		}
+		return RectF::FromPoints(tl, br).stretched(1);
+	}
 
-class MyClient : public Multiplayer_Photon
-{
-public:
-	MyClient()
-	{
-		init(std::string(SIV3D_OBFUSCATE(PHOTON_APP_ID)), VERSION, Verbose::No);
+	static ColorF StateColor(PlayerState state) {
+		switch (state) {
+		case PlayerState::Attack: return Palette::Red;
+		case PlayerState::Defense: return Palette::Blue;
+		default: return Palette::Green;
+		}
+	}
 
-		RegisterEventCallback(EventCode::sendShareGameData, &MyClient::eventReceived_sendShareGameData);
-		RegisterEventCallback(EventCode::startGame, &MyClient::eventReceived_startGame);
-		RegisterEventCallback(EventCode::changePlayerState, &MyClient::eventReceived_changePlayerState);
-		RegisterEventCallback(EventCode::finishGame, &MyClient::eventReceived_finishGame);
-		RegisterEventCallback(EventCode::players, &MyClient::eventReceived_players);
-		RegisterEventCallback(EventCode::enemyName, &MyClient::eventReceived_enemyName);
+	void drawShapes(const PlayerData& player, const PlayerData& enemy, double maxHp, double maxChargePoint) const {
+		m_layout.enemyCircle.stretched(10).draw(Palette::Black);
+		m_layout.enemyCircle.drawArc(0, enemy.chargePoint / maxChargePoint * Math::TwoPi, 0, 10, Palette::Orange);
+		m_layout.enemyCircle.draw(StateColor(enemy.state));
 
-	}
+		m_layout.enemyHpBar.draw(Palette::Black);
+		RectF(m_layout.enemyHpBar.pos, m_layout.enemyHpBar.w * (enemy.hp / maxHp), m_layout.enemyHpBar.h).draw(Palette::Lime);
 
-	Optional<ShareGameData> shareGameData;
+		m_layout.attackButton.draw(Palette::Red);
+		if (player.state == PlayerState::Attack) {
+			m_layout.attackButton.draw(ColorF(1, 0.5));
+		}
+		m_layout.defenseButton.draw(Palette::Blue);
+		if (player.state == PlayerState::Defense) {
+			m_layout.defenseButton.draw(ColorF(1, 0.5));
+		}
 
-	int32 myPlayerIndex = 0;
+		m_layout.chargeCircle.stretched(10).draw(Palette::Black);
+		m_layout.chargeCircle.draw(Palette::Green);
+		if (player.state == PlayerState::Charge) {
+			m_layout.chargeCircle.draw(ColorF(1, 0.5));
+		}
+		m_layout.chargeCircle.drawArc(0, player.chargePoint / maxChargePoint * Math::TwoPi, 0, 10, Palette::Orange);
 
-	String myPlayerName;
-	String enemyPlayerName;
+		m_layout.hpBar.draw(Palette::Black);
+		RectF(m_layout.hpBar.pos, m_layout.hpBar.w * (player.hp / maxHp), m_layout.hpBar.h).draw(Palette::Lime);
+	}
+};
 
-	Timer timer{ 3s };
+//フレーム時間と、画面に出るシミュレーション時刻の進み方のばらつきを測る
+//表示の進みがフレーム時間と一致していれば、ゲージは一定の速さで動いて見える
+class FramePacingMeter {
+public:
+	static constexpr size_t HistorySize = 240;
+
+	//frameSeconds はこのフレームの経過時間、displayedTime はこのフレームで描くシミュレーション時刻(秒)
+	void update(double frameSeconds, double displayedTime) {
+		if (m_hasLast) {
+			const double advance = displayedTime - m_lastDisplayedTime;
+
+			//再同期などで時刻が飛んだフレームは数えない
+			if (Abs(advance - frameSeconds) < 0.1) {
+				m_samples[m_head] = { frameSeconds * 1000, (advance - frameSeconds) * 1000 };
+				m_head = (m_head + 1) % HistorySize;
+				m_count = Min(m_count + 1, HistorySize);
+			}
+		}
 
-	void startGame(double maxHp, double maxChargePoint)
-	{
-		//ゲーム開始
-		if (not shareGameData) return;
-		shareGameData->maxHp = maxHp;
-		shareGameData->maxChargePoint = maxChargePoint;
-		sendEvent({ EventCode::startGame ,ReceiverOption::All }, maxHp, maxChargePoint);
+		m_lastDisplayedTime = displayedTime;
+		m_hasLast = true;
 	}
 
-	void changeState(PlayerState state)
-	{
-		//状態を変更する
-		if (not shareGameData) return;
-		sendEvent({ EventCode::changePlayerState, ReceiverOption::All }, myPlayerIndex, state);
+	void reset() {
+		m_hasLast = false;
+		m_head = 0;
+		m_count = 0;
 	}
 
-	void finishGame(int32 wonPlayer)
-	{
-		//ゲーム終了
-		if (not shareGameData) return;
-		sendEvent({ EventCode::finishGame ,ReceiverOption::All }, wonPlayer);
+	//フレーム時間の標準偏差(ミリ秒)
+	double frameJitterMillisec() const {
+		return standardDeviation(&Sample::frame);
 	}
 
-	void sendPlayers()
-	{
-		//プレイヤーのデータを送信する
-		if (not shareGameData) return;
-		sendEvent({ EventCode::players }, shareGameData->players);
+	//表示の進みとフレーム時間の差の標準偏差(ミリ秒)。補間していなければ、リフレッシュレートとステップの周期のずれがここに出る
+	double motionJitterMillisec() const {
+		return standardDeviation(&Sample::motion);
 	}
 
 private:
+	struct Sample {
+		double frame;
+		double motion;
+	};
 
-	//イベントを受信したらそれに応じた処理を行う
+	std::array<Sample, HistorySize> m_samples{};
+	size_t m_head = 0;
+	size_t m_count = 0;
+	double m_lastDisplayedTime = 0;
+	bool m_hasLast = false;
 
-	void eventReceived_sendShareGameData([[maybe_unused]] LocalPlayerID playerID, const ShareGameData& data)
-	{
-		shareGameData = data;
-	}
+	double standardDeviation(double Sample::* member) const {
+		if (m_count < 2) return 0;
 
-	void eventReceived_startGame([[maybe_unused]] LocalPlayerID playerID, double maxHp, double maxChargePoint)
-	{
-		if (not shareGameData) return;
-		shareGameData->maxHp = maxHp;
-		shareGameData->maxChargePoint = maxChargePoint;
-		shareGameData->gameState = GameState::Playing;
-		shareGameData->players = { PlayerData(maxHp, 0), PlayerData(maxHp, 0) };
-		if (playerID == getLocalPlayerID()) {
-			myPlayerIndex = 0;
+		double sum = 0;
+		for (size_t i = 0; i < m_count; ++i) {
+			sum += m_samples[i].*member;
 		}
-		else {
-			myPlayerIndex = 1;
+		const double mean = sum / m_count;
+
+		double variance = 0;
+		for (size_t i = 0; i < m_count; ++i) {
+			variance += Math::Square(m_samples[i].*member - mean);
 		}
-		timer.restart();
+		return Math::Sqrt(variance / (m_count - 1));
 	}
+};
 
-	void eventReceived_changePlayerState([[maybe_unused]] LocalPlayerID playerID, int32 playerIndex, PlayerState state)
-	{
-		if (not shareGameData) return;
-		shareGameData->players[playerIndex].state = state;
+# if SIV3D_PLATFORM(WEB)
+//swapInterval を渡したとき (CCLEMON_MAIN_LOOP_CALLBACK) は、省電力で間引いているメインループを入力ですぐ毎フレームに戻す
+EM_JS(void, setupActivityHandler, (uint32* counter, int32* swapInterval), {
+	function onActivity() {
+		HEAPU32[counter >> 2]++;
+
+		if (swapInterval && (HEAP32[swapInterval >> 2] > 1)) {
+			HEAP32[swapInterval >> 2] = 1;
+			_emscripten_set_main_loop_timing(1, 1);
+		}
 	}
 
-	void eventReceived_finishGame([[maybe_unused]] LocalPlayerID playerID, int32 wonPlayer)
-	{
-		if (not shareGameData) return;
-		shareGameData->wonPlayer = wonPlayer;
-		shareGameData->gameState = GameState::Finished;
+	for (const type of ["keydown", "keyup", "input", "compositionupdate", "pointerdown", "pointerup", "pointermove", "touchstart", "touchmove", "touchend", "wheel"]) {
+		window.addEventListener(type, onActivity, { capture: true, passive: true });
 	}
+	});
+# endif
 
-	void eventReceived_players([[maybe_unused]] LocalPlayerID playerID, const std::array<PlayerData, 2>& players)
-	{
-		if (not shareGameData) return;
-		shareGameData->players = players;
-	}
+//動きのない画面(名前入力・待機・結果)ではフレームレートを落とし、その間も通信はタイマーで回し続ける
+//入力があるか、イベントの受信などで画面の状態が変わったら、すぐに毎フレームの描画に戻す
+class IdleFrameScheduler {
+public:
+	//省電力中のフレームレート
+	double idleFrameRate = 10;
 
-	void eventReceived_enemyName([[maybe_unused]] LocalPlayerID playerID, const String& name)
-	{
-		enemyPlayerName = name;
+	//省電力中に通信を回す間隔(秒)
+	double networkInterval = 0.05;
+
+	//入力や変化がなくなってから省電力に入るまでの時間(秒)
+	double idleDelay = 0.5;
+
+	struct Stats {
+		uint64 activeFrames = 0;
+		uint64 idleFrames = 0;
+		double activeSeconds = 0;
+		double idleSeconds = 0;
+
+		//待っている間の入力・画面の変化で省電力をやめた回数
+		uint64 wakeups = 0;
+
+		//待っている間に通信を回した回数
+		uint64 networkPumps = 0;
+
+		//省電力中だった時間の割合
+		double idleResidency() const noexcept {
+			const double total = activeSeconds + idleSeconds;
+			return (total > 0) ? (idleSeconds / total) : 0.0;
+		}
+	};
+
+	IdleFrameScheduler() {
+# if CCLEMON_MAIN_LOOP_CALLBACK
+		setupActivityHandler(&m_activityCount, &m_swapInterval);
+# elif SIV3D_PLATFORM(WEB)
+		setupActivityHandler(&m_activityCount, nullptr);
+# endif
 	}
 
+	IdleFrameScheduler(const IdleFrameScheduler&) = delete;
 
-	void joinRoomEventAction(const LocalPlayer& newPlayer, [[maybe_unused]] const Array<LocalPlayerID>& playerIDs, bool isSelf) override
-	{
-		//自分が部屋に入った時
-		if (isSelf) {
-			shareGameData.reset();
-			sendEvent({ EventCode::enemyName, ReceiverOption::Others }, myPlayerName);
+	IdleFrameScheduler& operator =(const IdleFrameScheduler&) = delete;
+
+	//フレームの最初、通信を処理した後に呼ぶ
+	//animating は画面が動いているか(プレイ中・読み込み中など)。screenKey は画面の見た目を決める状態
+	void update(bool animating, uint64 screenKey) {
+		const double now = GetInputTimeStamp();
+
+		//直前のフレームをその時のモードに計上する
+		if (m_frameBegin > 0) {
+			const double seconds = (now - m_frameBegin) / 1000;
+			if (m_idle) {
+				++m_stats.idleFrames;
+				m_stats.idleSeconds += seconds;
+			}
+			else {
+				++m_stats.activeFrames;
+				m_stats.activeSeconds += seconds;
+			}
 		}
-		else {
-			sendEvent({ EventCode::enemyName ,{newPlayer.localID} }, myPlayerName);
+
+		m_frameBegin = now;
+
+		if (animating or takeActivity() or (screenKey != m_screenKey)) {
+			m_screenKey = screenKey;
+			m_lastActive = m_frameBegin;
 		}
 
-		//ホストが入室した時、つまり部屋を新規作成した時
-		if (isSelf and isHost()) {
-			shareGameData = ShareGameData();
+		m_idle = ((m_frameBegin - m_lastActive) >= idleDelay * 1000);
+	}
+
+	//フレームの最後に呼ぶ。省電力中なら次のフレームの時刻まで待ち、その間 pump() で通信を回す
+	//pump() の後に screenKey() が変わっていたら、待つのをやめて次のフレームを描く
+	template <class Pump, class ScreenKey>
+	void wait([[maybe_unused]] Pump pump, [[maybe_unused]] ScreenKey screenKey) {
+# if CCLEMON_MAIN_LOOP_CALLBACK
+		//次のフレームまでの間は Worker のタイマーが通信を回す (MultiplayerPhoton.js)
+		//待っている間の入力では、JS のイベントリスナが毎フレームに戻す (setupActivityHandler)
+		const int32 swapInterval = m_idle ? Max(static_cast<int32>(60 / idleFrameRate), 1) : 1;
+		if (swapInterval != m_swapInterval) {
+			m_swapInterval = swapInterval;
+			emscripten_set_main_loop_timing(EM_TIMING_RAF, swapInterval);
 		}
+# else
+		if (not m_idle) return;
 
-		//誰かが部屋に入って来た時、ホストはその人にデータを送る
-		if (not isSelf and isHost()) {
-			sendEvent({ EventCode::sendShareGameData, { newPlayer.localID } }, *shareGameData);
+		static constexpr TraceEventType TraceType{ U"idleWait", U"frame" };
+		ScopedTrace trace{ TraceType };
+
+		//次の System::Update() が表示の更新を 1 回待つので、その分早めに起きる
+		const double deadline = m_frameBegin + 1000.0 / idleFrameRate - 1000.0 / 60;
+		double nextPump = m_frameBegin + networkInterval * 1000;
+
+		for (double now = GetInputTimeStamp(); now < deadline; now = GetInputTimeStamp()) {
+			if (now >= nextPump) {
+				pump();
+				++m_stats.networkPumps;
+				nextPump = now + networkInterval * 1000;
+
+				if (screenKey() != m_screenKey) {
+					wake(now);
+					return;
+				}
+			}
+
+			if (takeActivity()) {
+				wake(now);
+				return;
+			}
+
+			//入力にすぐ気付けるよう、1 回に待つのは 1 フレーム分まで
+			const int32 sleepMillisec = Clamp(static_cast<int32>(Min(deadline, nextPump) - now), 1, 16);
+#	if SIV3D_PLATFORM(WEB)
+			emscripten_sleep(sleepMillisec);
+#	else
+			System::Sleep(sleepMillisec);
+#	endif
 		}
+# endif
 	}
 
-	void leaveRoomEventAction(LocalPlayerID playerID, bool isInactive) {
-		enemyPlayerName = U"";
+	bool isIdle() const noexcept { return m_idle; }
+
+	const Stats& stats() const noexcept { return m_stats; }
+
+private:
+	Stats m_stats;
+	bool m_idle = false;
+	double m_frameBegin = 0;
+	double m_lastActive = 0;
+	uint64 m_screenKey = 0;
+	uint32 m_activityCount = 0;
+	uint32 m_lastActivityCount = 0;
+# if CCLEMON_MAIN_LOOP_CALLBACK
+	int32 m_swapInterval = 1;
+# endif
+
+	void wake(double now) {
+		m_idle = false;
+		m_lastActive = now;
+		++m_stats.wakeups;
 	}
 
-	void leaveRoomReturn(int32 errorCode, const String& errorString) {
-		enemyPlayerName = U"";
+	//前回から入力があったか。Web では JS のイベントリスナが数えた回数、それ以外では Siv3D の入力を見る
+	//ネイティブでは待っている間の入力は次のフレームまで分からない
+	bool takeActivity() {
+# if SIV3D_PLATFORM(WEB)
+		const bool result = (m_activityCount != m_lastActivityCount);
+		m_lastActivityCount = m_activityCount;
+		return result;
+# else
+		return (not Cursor::Delta().isZero()) or (Mouse::Wheel() != 0)
+			or MouseL.pressed() or MouseR.pressed() or (not Keyboard::GetAllInputs().isEmpty());
+# endif
 	}
 };
 
 void Main()
 {
+	StartupTimeline startup;
+	startup.mark(U"main");
 
 # if SIV3D_PLATFORM(WEB)
-	setupMultiTouchHandler();
+	SetupMultiTouchHandler();
+	setupInputTimeStampHandler(&InputEdges.space, &InputEdges.shift, &InputEdges.mouseLeft);
+	setupVisibilityHandler();
 # endif
 
 
 
 	MyClient client;
 
+	//画面の見た目を決める状態。変わったら省電力をやめて描き直す
+	const auto screenKey = [&]() -> uint64 {
+		uint64 key = static_cast<uint64>(client.getClientState());
+		if (client.isInRoom()) {
+			key = key * 31 + client.getPlayerCountInCurrentRoom();
+			key = key * 31 + client.isHost();
+		}
+		if (client.shareGameData) {
+			key = key * 31 + static_cast<uint64>(client.shareGameData->gameState);
+			key = key * 31 + static_cast<uint64>(client.shareGameData->wonPlayer + 1);
+		}
+		return key * 31 + client.enemyPlayerName.hash();
+	};
+
+	IdleFrameScheduler idleScheduler;
+
+	//受信したデータを処理する。JS から呼ばれたコールバックの処理時間は photon の区間に計上する
+	const auto updateClient = [&]() {
+		if (not client.isActive()) return;
+
+		ScopedProfile profile{ FrameProfiler::Section::PhotonService };
+		static constexpr TraceEventType TraceType{ U"siv3dPhotonService", U"photon" };
+		ScopedTrace trace{ TraceType };
+		client.update();
+	};
+
+	//重い処理をメインスレッドの外で回す。スレッド版でないビルドではフレームの空き時間に少しずつ実行する
+	TaskScheduler::Start();
+	constexpr double InlineTaskBudgetMillisec = 2.0;
+
+# if SIV3D_BUILD(DEBUG)
+	std::future<Array<String>> rewindBenchmark;
+# endif
+
+	//非表示の間も Photon の接続は Worker のタイマーで維持される。ここでは中断を相手に知らせるだけ
+	//試合がなければ Worker での受信の処理も止め、ping だけにする
+	int32 hiddenPumpInterval = 0;
+	PageVisibility.onHidden = [&] {
+		client.suspend();
+# if SIV3D_PLATFORM(WEB)
+		if (not client.isInRoom()) {
+			hiddenPumpInterval = client.getNetworkPumpIntervalMillisec();
+			client.setNetworkPumpIntervalMillisec(0);
+		}
+# endif
+	};
+
+# if SIV3D_PLATFORM(WEB)
+	bool inRoom = false;
+	siv3dSetInRoom(inRoom);
+# endif
+
 	Font font(30);
+	startup.mark(U"font");
+
+	//文字列は変わったときだけ並べ直す
+	GlyphCache glyphCache{ font };
+	CachedText versionText{ glyphCache };
+	CachedText nameLabelText{ glyphCache };
+	CachedText enemyNameText{ glyphCache };
+	CachedText myNameText{ glyphCache };
+	CachedText countdownText{ glyphCache };
+	CachedText winText{ glyphCache };
+	CachedText loseText{ glyphCache };
+	CachedText vsText{ glyphCache };
+	CachedText playerCountText{ glyphCache };
+	CachedText suspendedText{ glyphCache };
+
+	//試合までに使う文字。ロビーにいる間にラスタライズしておき、カウントダウン開始時に引っかからないようにする
+	constexpr StringView MatchCharacters = U"0123456789スタートまで…You Win!Lose.vs player count:/";
+
+	//スライダーのラベルは値が変わったときだけ作り直す
+	String maxHpLabel;
+	String chargeLimitLabel;
+	int64 maxHpLabelValue = -1;
+	int64 chargeLimitLabelValue = -1;
 
 	Window::Resize(500, 800);
 
@@ -504,33 +2523,113 @@ void Main()
 	RectF defenseButtonRect(250 - 250, 500, 250, 250);
 	Circle chargeCircle(250, 670, 100);
 
+	HUDRenderer hud({ enemyStateCircle, chargeCircle, enemyHpBarRect, hpBarRect, attackButtonRect, defenseButtonRect });
+
+	TouchButtonRegistry touchButtons;
+	const auto attackTouchButton = touchButtons.add(attackButtonRect);
+	const auto defenseTouchButton = touchButtons.add(defenseButtonRect);
+
 	InputManageFlag attackInputFlag;
 	InputManageFlag defenseInputFlag;
 
 	double timeAccum = 0;
-	constexpr double timeStep = 1.0 / 60;
+	constexpr double timeStep = 1.0 / TickRate;
+
+	//1 フレームで追いつくステップ数の上限(約 0.13 秒分)。これを超えて遅れた分は捨て、ホストの状態に合わせ直す
+	constexpr int32 MaxCatchUpSteps = Max(TickRate * 2 / 15, 4);
+
+	//描画をステップの間で補間するか(F6 で切り替え)と、その滑らかさの計測
+	bool interpolateDisplay = true;
+	FramePacingMeter pacing;
+
+	IconAtlas icons{ U"resources/atlas/icons.json" };
 
-	Texture backSpaceIcon(0xF55a_icon, 20);
+	const TextureRegion backSpaceIcon = icons.get(0xF55a, 20);
 
 	double setting_maxHp = 100;
 	double setting_maxChargePoint = 200;
 
-	Texture swordIcon(0xF04E5_icon, 100);
-	Texture shieldIcon(0xF0499_icon, 100);
-	Texture chargeIcon(0xF00E8_icon, 100);
+	const TextureRegion swordIcon = icons.get(0xF04E5, 100);
+	const TextureRegion shieldIcon = icons.get(0xF0499, 100);
+	const TextureRegion chargeIcon = icons.get(0xF00E8, 100);
+	startup.mark(U"textures");
 
 	int32 lastKey = 0;
 
 	bool touches_enabled = false;
 
-	while (System::Update())
-	{
-		Touches.update();
+	versionText.set(U"v{}"_fmt(VERSION));
+	nameLabelText.set(U"Name:");
+	winText.set(U"You Win!");
+	loseText.set(U"You Lose...");
+	suspendedText.set(U"相手が中断しています");
+
+	//1 フレーム分の処理。System::Update() の後に呼ぶ
+	const auto frame = [&]() {
+		const uint64 frameBegin = Time::GetMicrosec();
+		FrameProfiler::BeginFrame();
+		AllocationTracker::BeginFrame();
+		startup.mark(U"firstUpdate");
+
+		static constexpr TraceEventType FrameTraceType{ U"frame", U"frame", U"frameCount" };
+		ScopedTrace frameTrace{ FrameTraceType, static_cast<int32>(Scene::FrameCount()) };
+
+		//F3 で処理時間のオーバーレイを切り替える
+		if (KeyF3.down()) {
+			FrameProfiler::Toggle();
+		}
+
+		//F4 でトレースの記録を切り替え、F8 で書き出す
+		if (KeyF4.down()) {
+			TraceRecorder::Toggle();
+		}
+		if (KeyF8.down() and TraceRecorder::Size() > 0) {
+			ExportTrace();
+		}
+
+		//F6 で描画の補間を切り替える(計測の比較用)
+		if (KeyF6.down()) {
+			interpolateDisplay = not interpolateDisplay;
+			pacing.reset();
+		}
+
+		//F7 でゲージ・ボタンをシェーダで描くか図形ごとに描くかを切り替える(計測の比較用)
+		if (KeyF7.down()) {
+			hud.useShader = not hud.useShader;
+		}
+
+# if SIV3D_BUILD(DEBUG)
+		if (KeyF9.down() and (not rewindBenchmark.valid())) {
+			rewindBenchmark = TaskScheduler::Submit(BenchmarkRewind);
+		}
+		if (IsReady(rewindBenchmark)) {
+			for (const auto& line : rewindBenchmark.get()) {
+				Print << line;
+			}
+		}
+# endif
+
+		{
+			ScopedProfile profile{ FrameProfiler::Section::Input };
+			Touches.update();
+			InputEdges.update();
+		}
 
 		if (Touches) {
 			touches_enabled = true;
 		}
 
+		//タブが戻ったら、止まっていた間を追いかけずにそこから再開する
+		if (PageVisibility.takeResume()) {
+			timeAccum = 0;
+			client.resume(PageVisibility.shownAt);
+# if SIV3D_PLATFORM(WEB)
+			if (hiddenPumpInterval > 0) {
+				client.setNetworkPumpIntervalMillisec(std::exchange(hiddenPumpInterval, 0));
+			}
+# endif
+		}
+
 		/*if (KeySpace.down()) {
 			lastKey = 0;
 		}
@@ -545,23 +2644,53 @@ void Main()
 		}
 		*/
 
-		if (client.isActive())
 		{
-			client.update();
+			ScopedProfile profile{ FrameProfiler::Section::Network };
+			updateClient();
+
+			//Photon の SDK は名前の入力画面を出している間に読み込む (web-player.html)。読み込みが終わり次第つなぐ
+# if SIV3D_PLATFORM(WEB)
+			const bool sdkLoaded = client.isSdkLoaded();
+# else
+			const bool sdkLoaded = true;
+# endif
+			if (client.connection.update(client, sdkLoaded)) {
+				startup.mark(U"connect");
+			}
+		}
+
+		//プレイ中と、スピナーを回している間は毎フレーム描く
+		{
+			const bool playing = (client.isInRoom() and client.shareGameData and client.shareGameData->gameState == GameState::Playing);
+			const bool loading = (not client.isInLobby()) and (not client.isInRoom() or not client.shareGameData);
+			idleScheduler.update((playing or loading) and (not PageVisibility.hidden), screenKey());
 		}
-		else {
-			client.connect(U"player", U"jp");
+
+# if SIV3D_PLATFORM(WEB)
+		if (client.isInRoom() != inRoom) {
+			inRoom = client.isInRoom();
+			siv3dSetInRoom(inRoom);
 		}
+# endif
 
-		if (client.isInLobby())
+		//名前の入力はロビーに入る前からできるようにし、接続を入力と並行して進める
+		if (client.isInLobby() or client.isConnectingToLobby() or client.isDisconnected())
 		{
+			startup.mark(U"interactive");
+			if (client.isInLobby()) {
+				startup.mark(U"lobby");
+			}
 			Scene::Rect().draw(Palette::Steelblue);
 
-			font(U"v{}"_fmt(VERSION)).draw(20, Vec2{ 5, 5 });
+			versionText.draw(20, Vec2{ 5, 5 });
 
-			font(U"Name:").drawAt(Scene::CenterF().moveBy(-150, -100), Palette::White);
+			nameLabelText.drawAt(Scene::CenterF().moveBy(-150, -100), Palette::White);
 			SimpleGUI::TextBoxAt(playerNameEditState, Scene::CenterF().moveBy(0, -100));
 
+			//入力中の名前も含め、試合で使う文字を先にラスタライズしておく
+			glyphCache.prewarm(MatchCharacters);
+			glyphCache.prewarm(playerNameEditState.text);
+
 			RoundRect backSpaceButton(Arg::center(Scene::CenterF().moveBy(130, -100)), 50, 30, 5);
 			backSpaceButton.draw(backSpaceButton.leftPressed() ? ColorF(0.9) : ColorF(1));
 			backSpaceButton.drawFrame(2, Palette::Gray);
@@ -574,11 +2703,24 @@ void Main()
 			}
 
 
-			if (SimpleGUI::ButtonAt(U"ランダムマッチ", Scene::Center(), 300))
+			//ロビーに入るまでは押せない。代わりに接続がどこまで進んだかを出す
+			String connectLabel = U"接続中…";
+			switch (client.connection.phase()) {
+			case ConnectionManager::Phase::Probing:
+				connectLabel = U"地域を測定中… ({} 件)"_fmt(client.connection.probes().size());
+				break;
+			case ConnectionManager::Phase::WaitingRetry:
+				connectLabel = U"再接続を待っています…";
+				break;
+			default:
+				break;
+			}
+
+			if (SimpleGUI::ButtonAt(client.isInLobby() ? U"ランダムマッチ" : connectLabel, Scene::Center(), 300, client.isInLobby()))
 			{
 				//適当な部屋に入るか、部屋がなければ新規作成する。空文字列を指定するとランダムな部屋名になる。
 				client.myPlayerName = playerNameEditState.text;
-				client.joinRandomOrCreateRoom(U"", RoomCreateOption().maxPlayers(2));
+				client.joinRandomOrCreateRoom(U"", RoomCreateOption().maxPlayers(2).rejoinGracePeriod(MyClient::RejoinGracePeriod));
 
 			}
 
@@ -587,6 +2729,7 @@ void Main()
 
 		if (client.isInRoom())
 		{
+			startup.mark(U"roomJoined");
 			Scene::Rect().draw(Palette::Sienna);
 
 
@@ -594,23 +2737,21 @@ void Main()
 			if (client.shareGameData) {
 				if (client.shareGameData->gameState == GameState::Playing) {
 					//プレイ中
+					if (not startup.isReported()) {
+						startup.mark(U"firstPlaying");
+						startup.report(VERSION);
+					}
 
 					const auto& player = client.shareGameData->players[client.myPlayerIndex];
 					const auto& enemy = client.shareGameData->players[1 - client.myPlayerIndex];
 
-					for (timeAccum += Scene::DeltaTime(); timeAccum >= timeStep; timeAccum -= timeStep) {
-						auto result = client.shareGameData->updateGame(timeStep);
-
-						if (result and client.isHost()) {
-							client.finishGame(result.value());
-						}
-					}
-
 					if (client.timer.reachedZero()) {
+						ScopedProfile inputProfile{ FrameProfiler::Section::Input };
 
 						if (touches_enabled) {
-							attackInputFlag.update(Touches.intersects(attackButtonRect));
-							defenseInputFlag.update(Touches.intersects(defenseButtonRect));
+							touchButtons.update(Touches);
+							attackInputFlag.update(touchButtons.pressed(attackTouchButton), touchButtons.edgeTimeStamp(attackTouchButton));
+							defenseInputFlag.update(touchButtons.pressed(defenseTouchButton), touchButtons.edgeTimeStamp(defenseTouchButton));
 						}
 						else {
 							bool attack_on = false;
@@ -621,11 +2762,17 @@ void Main()
 								attack_on |= attackButtonRect.intersects(Cursor::PosF());
 								defense_on |= defenseButtonRect.intersects(Cursor::PosF());
 							}
-							attackInputFlag.update(attack_on);
-							defenseInputFlag.update(defense_on);
+							const double keyboardTimeStamp = InputEdges.latest(InputEdges.space, InputEdges.mouseLeft);
+							const double shiftTimeStamp = InputEdges.latest(InputEdges.shift, InputEdges.mouseLeft);
+							attackInputFlag.update(attack_on, keyboardTimeStamp);
+							defenseInputFlag.update(defense_on, shiftTimeStamp);
 						}
 
-						if (attackInputFlag.down()) {
+						if (attackInputFlag.down() and defenseInputFlag.down()) {
+							//同じフレームで両方押されたら、押した時刻が後の方を優先する
+							lastKey = (attackInputFlag.downTimeStamp() >= defenseInputFlag.downTimeStamp()) ? 0 : 1;
+						}
+						else if (attackInputFlag.down()) {
 							lastKey = 0;
 						}
 						else if (defenseInputFlag.down()) {
@@ -685,77 +2832,100 @@ void Main()
 						//	}
 						//}
 
-						if (changeState != player.state) {
-							client.changeState(changeState);
-							if (client.isHost()) {
-								client.shareGameData->players[client.myPlayerIndex].state = changeState;
-								client.sendPlayers();
+						//このフレームで押した・離した時刻のうち最も新しいもの
+						double changeTimeStamp = 0;
+						for (const auto* flag : { &attackInputFlag, &defenseInputFlag }) {
+							if (flag->down() or flag->up()) {
+								changeTimeStamp = Max(changeTimeStamp, flag->edgeTimeStamp());
+							}
+						}
+
+						client.requestState(changeState, (changeTimeStamp > 0) ? changeTimeStamp : GetInputTimeStamp());
+					}
+
+					//入力を先に処理し、押した時刻に対応するステップから反映する
+					client.updateOpponentWait();
+					timeAccum += Scene::DeltaTime();
+					if (client.isWaitingForHost() or client.isWaitingForOpponent()) {
+						timeAccum = 0;
+					}
+					else if (timeAccum > timeStep * MaxCatchUpSteps) {
+						//捨てたステップは相手より遅れたままになるので、数えて合わせ直す
+						const int32 dropped = static_cast<int32>((timeAccum - timeStep * MaxCatchUpSteps) / timeStep);
+						timeAccum -= dropped * timeStep;
+						client.dropTicks(dropped);
+					}
+					const double frameTimeStamp = GetInputTimeStamp();
+					{
+						ScopedProfile simulationProfile{ FrameProfiler::Section::Simulation };
+						for (; timeAccum >= timeStep; timeAccum -= timeStep) {
+							//このステップが表す時刻
+							const double tickTimeStamp = frameTimeStamp - (timeAccum - timeStep) * 1000;
+							auto result = client.stepGame(timeStep, tickTimeStamp);
+
+							if (result and client.isHost()) {
+								client.finishGame(result.value());
 							}
 						}
 					}
 
 
+					//余った時間の割合。描画は直前の 2 ステップの間をこの割合で補間した値で描く
+					const double alpha = interpolateDisplay ? (timeAccum / timeStep) : 1.0;
+
+					if (client.timer.reachedZero() and not (client.isWaitingForHost() or client.isWaitingForOpponent())) {
+						pacing.update(Scene::DeltaTime(), (client.shareGameData->tick - 1 + alpha) * timeStep);
+					}
+					else {
+						pacing.reset();
+					}
+
 					//draw
-					enemyStateCircle.stretched(10).draw(Palette::Black);
-					enemyStateCircle.drawArc(0, enemy.chargePoint / client.shareGameData->maxChargePoint * Math::TwoPi, 0, 10, Palette::Orange);
+					ScopedProfile drawProfile{ FrameProfiler::Section::Draw };
+					//ゲージは直前の 2 ステップの間を補間した値で描く。巻き戻しや状態のもらい直しの直後は前の表示から寄せる
+					const auto displayPlayers = client.getDisplayPlayers(alpha);
+					const auto& displayPlayer = displayPlayers[client.myPlayerIndex];
+					const auto& displayEnemy = displayPlayers[1 - client.myPlayerIndex];
+
+					//ゲージとボタンはまとめて描き、白いアイコンをその上に重ねる
+					hud.draw(PlayerData{ player.state, displayPlayer.hp, displayPlayer.chargePoint }, PlayerData{ enemy.state, displayEnemy.hp, displayEnemy.chargePoint }, client.shareGameData->maxHp, client.shareGameData->maxChargePoint);
 
 					if (enemy.state == PlayerState::Charge) {
-						enemyStateCircle.draw(Palette::Green);
 						chargeIcon.drawAt(enemyStateCircle.center, Palette::White);
 					}
 					else if (enemy.state == PlayerState::Attack) {
-						enemyStateCircle.draw(Palette::Red);
 						swordIcon.drawAt(enemyStateCircle.center, Palette::White);
 					}
 					else if (enemy.state == PlayerState::Defense) {
-						enemyStateCircle.draw(Palette::Blue);
 						shieldIcon.drawAt(enemyStateCircle.center, Palette::White);
 					}
-
-					enemyHpBarRect.draw(Palette::Black);
-					RectF enemyHpBarRect2(enemyHpBarRect.pos, enemyHpBarRect.w * (enemy.hp / client.shareGameData->maxHp), enemyHpBarRect.h);
-					enemyHpBarRect2.draw(Palette::Lime);
-
-					attackButtonRect.draw(Palette::Red);
 					swordIcon.drawAt(attackButtonRect.center() + Vec2(50, 0), Palette::White);
-					if (player.state == PlayerState::Attack) {
-						attackButtonRect.draw(ColorF(1, 0.5));
-					}
-					defenseButtonRect.draw(Palette::Blue);
 					shieldIcon.drawAt(defenseButtonRect.center() - Vec2(50, 0), Palette::White);
-					if (player.state == PlayerState::Defense) {
-						defenseButtonRect.draw(ColorF(1, 0.5));
-					}
-					chargeCircle.stretched(10).draw(Palette::Black);
-					chargeCircle.draw(Palette::Green);
 					chargeIcon.drawAt(chargeCircle.center, Palette::White);
-					if (player.state == PlayerState::Charge) {
-						chargeCircle.draw(ColorF(1, 0.5));
-					}
-					chargeCircle.drawArc(0, player.chargePoint / client.shareGameData->maxChargePoint * Math::TwoPi, 0, 10, Palette::Orange);
-					hpBarRect.draw(Palette::Black);
-					RectF hpBarRect2(hpBarRect.pos, hpBarRect.w * (player.hp / client.shareGameData->maxHp), hpBarRect.h);
-					hpBarRect2.draw(Palette::Lime);
 
 					//敵の名前を表示
-					font(client.enemyPlayerName).draw(20, Vec2{ 5,5 }, Palette::White);
+					enemyNameText.set(client.enemyPlayerName).draw(20, Vec2{ 5,5 }, Palette::White);
 					//自分の名前を表示
-					font(client.myPlayerName).drawBase(20, Vec2{ 5, Scene::Height() - 5 }, Palette::White);
+					myNameText.set(client.myPlayerName).drawBase(20, Vec2{ 5, Scene::Height() - 5 }, Palette::White);
 
 
-					if (not client.timer.reachedZero()) {
+					if (client.isWaitingForHost() or client.isWaitingForOpponent() or client.suspendedPlayers[1 - client.myPlayerIndex]) {
+						Scene::Rect().draw(ColorF(0, 0.5));
+						suspendedText.drawAt(Scene::CenterF(), Palette::White);
+					}
+					else if (not client.timer.reachedZero()) {
 						Scene::Rect().draw(ColorF(0, 0.5));
-						font(U"スタートまで…{}"_fmt(client.timer.s_ceil())).drawAt(Scene::CenterF(), Palette::White);
+						countdownText.set(client.timer.s_ceil(), [&] { return U"スタートまで…{}"_fmt(client.timer.s_ceil()); }).drawAt(Scene::CenterF(), Palette::White);
 					}
 				}
 				else if (client.shareGameData->gameState == GameState::Finished) {
 					//終了
 					//font(U"GameState: Finished").drawAt(Scene::CenterF().moveBy(0, -100), Palette::White);
 					if (client.shareGameData->wonPlayer == client.myPlayerIndex) {
-						font(U"You Win!").drawAt(Scene::CenterF().moveBy(0, 0), Palette::White);
+						winText.drawAt(Scene::CenterF().moveBy(0, 0), Palette::White);
 					}
 					else {
-						font(U"You Lose...").drawAt(Scene::CenterF().moveBy(0, 0), Palette::White);
+						loseText.drawAt(Scene::CenterF().moveBy(0, 0), Palette::White);
 					}
 					if (SimpleGUI::ButtonAt(U"Restart", Scene::CenterF().moveBy(0, 200), 300)) {
 						//ゲーム再開
@@ -770,12 +2940,20 @@ void Main()
 					if (client.enemyPlayerName.isEmpty()) {
 					}
 					else {
-						font(U"vs. {}"_fmt(client.enemyPlayerName)).drawAt(Scene::CenterF().moveBy(0, -100), Palette::White);
+						vsText.set(static_cast<int64>(client.enemyPlayerName.hash()), [&] { return U"vs. {}"_fmt(client.enemyPlayerName); }).drawAt(Scene::CenterF().moveBy(0, -100), Palette::White);
 					}
 
 					if (client.isHost()) {
-						SimpleGUI::SliderAt(U"MaxHp:{}"_fmt(Floor(setting_maxHp / 10) * 10), setting_maxHp, 50, 1000, Scene::CenterF().moveBy(0, -300), 120, 240);
-						SimpleGUI::SliderAt(U"ChargeLimit:{}"_fmt(Floor(setting_maxChargePoint / 10) * 10), setting_maxChargePoint, 50, 1000, Scene::CenterF().moveBy(0, -200), 180, 240);
+						if (const int64 value = static_cast<int64>(Floor(setting_maxHp / 10)); value != maxHpLabelValue) {
+							maxHpLabelValue = value;
+							maxHpLabel = U"MaxHp:{}"_fmt(Floor(setting_maxHp / 10) * 10);
+						}
+						if (const int64 value = static_cast<int64>(Floor(setting_maxChargePoint / 10)); value != chargeLimitLabelValue) {
+							chargeLimitLabelValue = value;
+							chargeLimitLabel = U"ChargeLimit:{}"_fmt(Floor(setting_maxChargePoint / 10) * 10);
+						}
+						SimpleGUI::SliderAt(maxHpLabel, setting_maxHp, 50, 1000, Scene::CenterF().moveBy(0, -300), 120, 240);
+						SimpleGUI::SliderAt(chargeLimitLabel, setting_maxChargePoint, 50, 1000, Scene::CenterF().moveBy(0, -200), 180, 240);
 
 
 
@@ -787,7 +2965,7 @@ void Main()
 						}
 					}
 
-					font(U"player count: {} / 2"_fmt(client.getPlayerCountInCurrentRoom())).drawAt(Scene::CenterF().moveBy(0, 0), Palette::White);
+					playerCountText.set(client.getPlayerCountInCurrentRoom(), [&] { return U"player count: {} / 2"_fmt(client.getPlayerCountInCurrentRoom()); }).drawAt(Scene::CenterF().moveBy(0, 0), Palette::White);
 
 				}
 			}
@@ -803,9 +2981,56 @@ void Main()
 			}
 		}
 
-		if (not (client.isDisconnected() or client.isInLobby() or client.isInRoom())) {
+		if (not (client.isDisconnected() or client.isConnectingToLobby() or client.isInLobby() or client.isInRoom())) {
 			drawLoadingSpinner();
 		}
+
+		FrameProfiler::DrawOverlay(font);
+		if (FrameProfiler::IsEnabled()) {
+			font(U"glyph hit/miss: {} / {}"_fmt(glyphCache.hits(), glyphCache.misses())).draw(12, Vec2{ 260, Scene::Height() - 21 }, Palette::White);
+			const auto& idleStats = idleScheduler.stats();
+			font(U"idle: {:.0f}% ({} frames, {} wakeups)"_fmt(idleStats.idleResidency() * 100, idleStats.idleFrames, idleStats.wakeups)).draw(12, Vec2{ 260, Scene::Height() - 37 }, Palette::White);
+			font(U"resume: {:.1f} ms ({} times)"_fmt(client.lastResumeMillisec, client.resumeCount)).draw(12, Vec2{ 260, Scene::Height() - 53 }, Palette::White);
+			font(U"jitter: frame {:.2f} / motion {:.2f} ms{}"_fmt(pacing.frameJitterMillisec(), pacing.motionJitterMillisec(), interpolateDisplay ? U"" : U" (no interp)")).draw(12, Vec2{ 260, Scene::Height() - 69 }, Palette::White);
+			font(U"tasks: {} workers, {} pending"_fmt(TaskScheduler::WorkerCount(), TaskScheduler::PendingCount())).draw(12, Vec2{ 260, Scene::Height() - 85 }, Palette::White);
+			font(U"connect: {}{} {:.0f} ms ({} tries, {} failed, probe {:.0f} ms)"_fmt(client.connection.region(), client.connection.isRegionFromCache() ? U"*" : U"", client.connection.lastConnectMillisec(), client.connection.attempts(), client.connection.failures(), client.connection.probeMillisec())).draw(12, Vec2{ 260, Scene::Height() - 101 }, Palette::White);
+			font(U"handoff: {:.1f} ms, rewind {} ticks ({} times)"_fmt(client.lastHandoffMillisec, client.lastHandoffRewindTicks, client.handoffCount)).draw(12, Vec2{ 260, Scene::Height() - 117 }, Palette::White);
+			//描画回数は前のフレームの値。処理時間は上の draw / frame の行と合わせて見る
+			const auto drawStat = Profiler::GetStat();
+			font(U"hud: {}, {} draw calls, {} triangles, {} icon fallbacks"_fmt(hud.isShaderActive() ? U"shader" : U"shapes", drawStat.drawCalls, drawStat.triangleCount, icons.fallbackCount())).draw(12, Vec2{ 260, Scene::Height() - 133 }, Palette::White);
+			font(U"state: {} sent, {} suppressed"_fmt(client.sentStateChangeCount, client.suppressedToggleCount)).draw(12, Vec2{ 260, Scene::Height() - 149 }, Palette::White);
+			font(U"dropped: {} ticks ({} resyncs)"_fmt(client.droppedTickCount, client.dropResyncCount)).draw(12, Vec2{ 260, Scene::Height() - 165 }, Palette::White);
+		}
+
+		TaskScheduler::RunPending(InlineTaskBudgetMillisec);
+
+		startup.addFrameCost((Time::GetMicrosec() - frameBegin) / 1000.0);
+
+		//動きのない画面では次のフレームまで待つ。その間も通信は回す
+		idleScheduler.wait([&] {
+			ScopedProfile profile{ FrameProfiler::Section::Network };
+			updateClient();
+		}, screenKey);
+	};
+
+# if CCLEMON_MAIN_LOOP_CALLBACK
+	//ブラウザの requestAnimationFrame から frame を呼ぶ。simulate_infinite_loop で Main() から戻らないので、
+	//ここまでのローカル変数はフレームの間も残る
+	emscripten_set_main_loop_arg([](void* arg) {
+		if (not System::Update()) {
+			emscripten_cancel_main_loop();
+			TaskScheduler::Stop();
+			return;
+		}
+		(*static_cast<decltype(frame)*>(arg))();
+	}, const_cast<void*>(static_cast<const void*>(&frame)), 0, true);
+# else
+	while (System::Update())
+	{
+		frame();
 	}
+
+	TaskScheduler::Stop();
+# endif
 }
 
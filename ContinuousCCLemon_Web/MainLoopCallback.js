@@ -0,0 +1,10 @@
+// ReleaseNoAsyncify 用 (CCLEMON_MAIN_LOOP_CALLBACK)
+// フレームはブラウザの requestAnimationFrame (emscripten_set_main_loop_arg) から 1 回ずつ呼ばれるので、
+// System::Update() の中で次の表示の更新を待つ Siv3D.js の実装 (Asyncify が必要) を何もしないものに置き換える
+mergeInto(LibraryManager.library, {
+    siv3dRequestAnimationFrame: function () {},
+    siv3dRequestAnimationFrame__sig: "v",
+
+    siv3dSleepUntilWaked: function () {},
+    siv3dSleepUntilWaked__sig: "v",
+});
@@ -9,6 +9,81 @@ mergeInto(LibraryManager.library, {
 
     $siv3dPhotonClient: null,
 
+    // Photon の SDK (photon.js) は wasm とは別に読み込む。web-player.html がページを開いた時点で読み込みを始め、
+    // 名前の入力と並行して進める。ページ側で始めていなければここで読み込む
+    $siv3dPhotonSdk: {
+        promise: null,
+        failed: false,
+        appID: "",
+        appVersion: "",
+        verbose: false,
+        protocol: 0,
+    },
+
+    // ページ側のタグは、読み込みが終わると data-photon-sdk に "loaded" か "error" を書く (web-player.html)
+    // まだ読み込み中のタグ (data-photon-sdk="") があればその完了を待ち、なければ新しいタグで読み込む
+    // 失敗したタグは取り除くので、次に呼んだときは読み込み直す
+    $siv3dPhotonLoadSdk: function () {
+        if (siv3dPhotonSdk.promise === null) {
+            siv3dPhotonSdk.promise = new Promise(function (resolve, reject) {
+                if (typeof Photon !== "undefined") {
+                    resolve();
+                    return;
+                }
+
+                let script = document.querySelector("script[data-photon-sdk='']");
+                if (script === null) {
+                    script = document.createElement("script");
+                    script.src = "photon.js";
+                    script.async = true;
+                    script.dataset.photonSdk = "";
+                    document.head.appendChild(script);
+                }
+
+                script.addEventListener("load", function () {
+                    if (typeof Photon !== "undefined") {
+                        resolve();
+                    } else {
+                        reject(new Error("photon.js did not define Photon"));
+                    }
+                });
+                script.addEventListener("error", function (e) {
+                    script.remove();
+                    reject(e);
+                });
+            }).catch(function (e) {
+                siv3dPhotonSdk.promise = null;
+                throw e;
+            });
+        }
+        return siv3dPhotonSdk.promise;
+    },
+    $siv3dPhotonLoadSdk__deps: ["$siv3dPhotonSdk"],
+
+    // SDK を読み込んでクライアントを作る。失敗したら siv3dPhotonSdk.failed を立て、C++ 側が間隔を空けて siv3dPhotonReloadSdk() を呼ぶ
+    $siv3dPhotonStartClient: function () {
+        siv3dPhotonSdk.failed = false;
+
+        siv3dPhotonLoadSdk().then(function () {
+            siv3dPhotonCreateClient(siv3dPhotonSdk.appID, siv3dPhotonSdk.appVersion, siv3dPhotonSdk.verbose, siv3dPhotonSdk.protocol);
+        }, function (e) {
+            siv3dPhotonSdk.failed = true;
+            console.error("[Multiplayer_Photon] [js] failed to load the Photon SDK: ", e);
+        });
+    },
+    $siv3dPhotonStartClient__deps: ["$siv3dPhotonSdk", "$siv3dPhotonLoadSdk", "$siv3dPhotonCreateClient"],
+
+    // 描画のフレームとは別に通信を処理するためのタイマー
+    // Worker のタイマーは非表示のタブでもメインスレッドのタイマーほど間引かれないので、ping と受信の処理をこちらで回す
+    $siv3dPhotonPump: {
+        worker: null,
+        fallbackTimer: null,
+        interval: 50,
+        pingInterval: 2000,
+        lastPing: 0,
+        lastService: 0,
+    },
+
     $siv3dPhotonCallbackCode: {
         ConnectionErrorReturn: 1,
         ConnectReturn: 11,
@@ -38,10 +113,179 @@ mergeInto(LibraryManager.library, {
 		Disconnecting: 6,
     },
 
+    // SDK の読み込みが終わったらクライアントを作る。それまで siv3dPhotonClient は null
     siv3dPhotonInitClient: function (appID_ptr, appVersion_ptr, verbose, protocol) {
         const appID = UTF32ToString(appID_ptr);
         const appVersion = UTF32ToString(appVersion_ptr);
-        
+
+        // 地域ごとの接続時間を測るクライアントや、読み込み直したときのクライアントも同じ設定で作る
+        siv3dPhotonSdk.appID = appID;
+        siv3dPhotonSdk.appVersion = appVersion;
+        siv3dPhotonSdk.verbose = verbose;
+        siv3dPhotonSdk.protocol = protocol;
+
+        siv3dPhotonStartClient();
+    },
+    siv3dPhotonInitClient__sig: "viiii",
+    siv3dPhotonInitClient__deps: ["$siv3dPhotonSdk", "$siv3dPhotonStartClient"],
+
+    siv3dPhotonIsSdkLoaded: function () {
+        return siv3dPhotonClient !== null;
+    },
+    siv3dPhotonIsSdkLoaded__sig: "i",
+    siv3dPhotonIsSdkLoaded__deps: ["$siv3dPhotonClient"],
+
+    siv3dPhotonIsSdkLoadFailed: function () {
+        return siv3dPhotonSdk.failed;
+    },
+    siv3dPhotonIsSdkLoadFailed__sig: "i",
+    siv3dPhotonIsSdkLoadFailed__deps: ["$siv3dPhotonSdk"],
+
+    siv3dPhotonReloadSdk: function () {
+        if (siv3dPhotonClient === null && siv3dPhotonSdk.failed) {
+            siv3dPhotonStartClient();
+        }
+    },
+    siv3dPhotonReloadSdk__sig: "v",
+    siv3dPhotonReloadSdk__deps: ["$siv3dPhotonClient", "$siv3dPhotonSdk", "$siv3dPhotonStartClient"],
+
+    // 地域ごとに一時的なクライアントでネームサーバ経由でマスターサーバにつなぎ、マスターサーバへの接続にかかった時間を返す
+    // ネームサーバまでの時間はどの地域でも同じなので含めない。失敗・タイムアウトは -1
+    $siv3dPhotonProbeMaster: function (region, timeoutMillisec) {
+        return new Promise(function (resolve) {
+            const State = Photon.LoadBalancing.LoadBalancingClient.State;
+            const client = new Photon.LoadBalancing.LoadBalancingClient(siv3dPhotonSdk.protocol, siv3dPhotonSdk.appID, siv3dPhotonSdk.appVersion);
+            let start = performance.now();
+            let done = false;
+
+            const finish = function (rtt) {
+                if (done) {
+                    return;
+                }
+                done = true;
+                clearTimeout(timeout);
+                siv3dPhotonProbeCancels.splice(siv3dPhotonProbeCancels.indexOf(cancel), 1);
+                resolve(rtt);
+                client.disconnect();
+            };
+            const cancel = () => finish(null);
+            siv3dPhotonProbeCancels.push(cancel);
+            const timeout = setTimeout(() => finish(-1), timeoutMillisec);
+
+            client.setLogLevel(Photon.LogLevel.ERROR);
+            client.onStateChange = function (state) {
+                if (state === State.ConnectingToMasterserver) {
+                    start = performance.now();
+                } else if (state === State.ConnectedToMaster || state === State.JoinedLobby) {
+                    finish(performance.now() - start);
+                } else if (state === State.Error || state === State.Disconnected) {
+                    finish(-1);
+                }
+            };
+            client.onError = function () {
+                finish(-1);
+            };
+
+            if (!client.connectToRegionMaster(region)) {
+                finish(-1);
+            }
+        });
+    },
+    $siv3dPhotonProbeMaster__deps: ["$siv3dPhotonSdk", "$siv3dPhotonProbeCancels"],
+
+    // WebSocket の接続が開くまでの時間。?photonProbe= で指定した中継 (tools/latency_relay.py) を測るときに使う
+    $siv3dPhotonProbeWebSocket: function (address, timeoutMillisec) {
+        return new Promise(function (resolve) {
+            const start = performance.now();
+            let socket;
+            try {
+                socket = new WebSocket(address);
+            } catch (e) {
+                resolve(-1);
+                return;
+            }
+
+            let done = false;
+            const finish = function (rtt) {
+                if (done) {
+                    return;
+                }
+                done = true;
+                clearTimeout(timeout);
+                siv3dPhotonProbeCancels.splice(siv3dPhotonProbeCancels.indexOf(cancel), 1);
+                resolve(rtt);
+                socket.close();
+            };
+            const cancel = () => finish(null);
+            siv3dPhotonProbeCancels.push(cancel);
+            const timeout = setTimeout(() => finish(-1), timeoutMillisec);
+
+            socket.onopen = () => finish(performance.now() - start);
+            socket.onerror = () => finish(-1);
+        });
+    },
+    $siv3dPhotonProbeWebSocket__deps: ["$siv3dPhotonProbeCancels"],
+
+    // 測定中の接続を打ち切る関数。打ち切った測定は結果を返さない
+    $siv3dPhotonProbeCancels: [],
+
+    // ?photonProbe=jp=ws://localhost:9101,us=ws://localhost:9102 のように、地域ごとに Photon の代わりに測るアドレスを指定できる
+    $siv3dPhotonProbeOverrides: function () {
+        const overrides = new Map();
+        const param = new URLSearchParams(location.search).get("photonProbe");
+
+        for (const entry of (param ? param.split(",") : [])) {
+            const separator = entry.indexOf("=");
+            if (separator > 0) {
+                overrides.set(entry.slice(0, separator), entry.slice(separator + 1));
+            }
+        }
+
+        return overrides;
+    },
+
+    // regions はカンマ区切り。結果は地域ごとに、測り終えた順に siv3dPhotonRegionProbeCallback で返す
+    // timeoutMillisec を過ぎても接続できない地域は -1
+    siv3dPhotonProbeRegions: function (regions_ptr, timeoutMillisec) {
+        if (siv3dPhotonClient === null) {
+            return false;
+        }
+
+        const regions = UTF32ToString(regions_ptr).split(",").filter((region) => region.length > 0);
+        const overrides = siv3dPhotonProbeOverrides();
+
+        for (const region of regions) {
+            const probe = overrides.has(region) ? siv3dPhotonProbeWebSocket(overrides.get(region), timeoutMillisec) : siv3dPhotonProbeMaster(region, timeoutMillisec);
+            probe.then(function (rtt) {
+                if (rtt !== null) {
+                    _siv3dPhotonRegionProbeCallback(siv3dStringToNewUTF32(region), rtt < 0 ? -1 : Math.round(rtt));
+                }
+            });
+        }
+
+        return true;
+    },
+    siv3dPhotonProbeRegions__sig: "iii",
+    siv3dPhotonProbeRegions__deps: [
+        "$siv3dPhotonClient",
+        "$siv3dPhotonProbeMaster",
+        "$siv3dPhotonProbeWebSocket",
+        "$siv3dPhotonProbeOverrides",
+        "siv3dPhotonRegionProbeCallback",
+        "$siv3dStringToNewUTF32",
+        "$UTF32ToString"
+    ],
+
+    // 地域を選び終えたら、まだ終わっていない測定の接続を切る。測定の接続も同時接続数 (CCU) に数えられる
+    siv3dPhotonCancelRegionProbes: function () {
+        for (const cancel of siv3dPhotonProbeCancels.slice()) {
+            cancel();
+        }
+    },
+    siv3dPhotonCancelRegionProbes__sig: "v",
+    siv3dPhotonCancelRegionProbes__deps: ["$siv3dPhotonProbeCancels"],
+
+    $siv3dPhotonCreateClient: function (appID, appVersion, verbose, protocol) {
         if (siv3dPhotonClient !== null) {
             siv3dPhotonClient.disconnect();
         }
@@ -132,9 +376,12 @@ mergeInto(LibraryManager.library, {
             }
         };
         
+        // 再参加の猶予 (playerTTL) があるルームで、接続が切れたときと、猶予の間に戻ってきたときに呼ばれる
         siv3dPhotonClient.onActorSuspend = function (actor) {
-            if (!cleanup) {
+            if (actor.isSuspended()) {
                 siv3dPhotonClient.callbackCacheList.push({ type: siv3dPhotonCallbackCode.ActorLeave, actorNr: actor.actorNr, isSuspended: true });
+            } else {
+                siv3dPhotonClient.callbackCacheList.push({ type: siv3dPhotonCallbackCode.ActorJoin, actorNr: actor.actorNr, myself: false });
             }
         };
         
@@ -160,14 +407,15 @@ mergeInto(LibraryManager.library, {
             }
         };
 
-        if (!siv3dPhotonClient.pingInterval) {
-            siv3dPhotonSetPingInterval(2000);
-        }
+        siv3dPhotonStartPump();
     },
-    siv3dPhotonInitClient__sig: "viiii",
-    siv3dPhotonInitClient__deps: ["$siv3dPhotonClient", "$siv3dPhotonCallbackCode", "$siv3dPhotonClientState", "$siv3dPhotonSetPingInterval"],
+    $siv3dPhotonCreateClient__deps: ["$siv3dPhotonClient", "$siv3dPhotonCallbackCode", "$siv3dPhotonClientState", "$siv3dPhotonStartPump"],
 
     siv3dPhotonConnect: function (userId_ptr, region_ptr) {
+        if (siv3dPhotonClient === null) {
+            return false;
+        }
+
         siv3dPhotonClient.disconnect();
 
         siv3dPhotonClient.setUserId(UTF32ToString(userId_ptr));
@@ -190,6 +438,10 @@ mergeInto(LibraryManager.library, {
     siv3dPhotonConnect__deps: ["$siv3dPhotonClient", "$siv3dPhotonCallbackCode"],
 
     siv3dPhotonDisconnect: function () {
+        if (siv3dPhotonClient === null) {
+            return;
+        }
+
         siv3dPhotonClient.waitingCallback = siv3dPhotonCallbackCode.DisconnectReturn;
         siv3dPhotonClient.disconnect();
     },
@@ -197,6 +449,8 @@ mergeInto(LibraryManager.library, {
     siv3dPhotonDisconnect__deps: ["$siv3dPhotonClient", "$siv3dPhotonCallbackCode"],
 
     siv3dPhotonService: function () {
+        siv3dPhotonPump.lastService = performance.now();
+
         if (siv3dPhotonClient.isJoinedToRoom())
         {
             const host = siv3dPhotonClient.myRoomMasterActorNr();
@@ -293,6 +547,7 @@ mergeInto(LibraryManager.library, {
     siv3dPhotonService__sig: "v",
     siv3dPhotonService__deps: [
         "$siv3dPhotonClient",
+        "$siv3dPhotonPump",
         "$siv3dPhotonCallbackCode",
         "siv3dPhotonGeneralCallback",
         "siv3dPhotonClientStateChangeCallback",
@@ -309,13 +564,63 @@ mergeInto(LibraryManager.library, {
         "$lengthBytesUTF16"
     ],
 
-    $siv3dPhotonSetPingInterval: function (interval) {
-        clearInterval(siv3dPhotonClient.pingInterval);
-        siv3dPhotonClient.pingInterval = setInterval(function () {
+    $siv3dPhotonStartPump: function () {
+        if (siv3dPhotonPump.worker === null) {
+            try {
+                const source = "let timer = null; onmessage = (e) => { clearInterval(timer); timer = setInterval(() => postMessage(0), e.data); };";
+                siv3dPhotonPump.worker = new Worker(URL.createObjectURL(new Blob([source], { type: "text/javascript" })));
+                siv3dPhotonPump.worker.onmessage = siv3dPhotonPumpTick;
+            } catch (e) {
+                // CSP などで Worker を作れないときはメインスレッドのタイマーで代用する
+                console.warn("[Multiplayer_Photon] [js] worker pump is unavailable: ", e);
+                siv3dPhotonPump.worker = {
+                    postMessage: function (interval) {
+                        clearInterval(siv3dPhotonPump.fallbackTimer);
+                        siv3dPhotonPump.fallbackTimer = setInterval(siv3dPhotonPumpTick, interval);
+                    },
+                };
+            }
+        }
+
+        // interval が 0 のときは受信の処理はせず、ping のためだけに回す
+        siv3dPhotonPump.worker.postMessage(siv3dPhotonPump.interval > 0 ? Math.min(siv3dPhotonPump.interval, siv3dPhotonPump.pingInterval) : siv3dPhotonPump.pingInterval);
+    },
+    $siv3dPhotonStartPump__deps: ["$siv3dPhotonPump", "$siv3dPhotonPumpTick"],
+
+    $siv3dPhotonPumpTick: function () {
+        if (siv3dPhotonClient === null) {
+            return;
+        }
+
+        const now = performance.now();
+
+        if (now - siv3dPhotonPump.lastPing >= siv3dPhotonPump.pingInterval) {
+            siv3dPhotonPump.lastPing = now;
             siv3dPhotonClient.updateRtt();
-        }, interval);
+        }
+
+        // フレームが止まっている間 (非表示のタブ・長いフレーム) は、受信したものをここで C++ に渡す
+        if (siv3dPhotonPump.interval > 0
+            && siv3dPhotonClient.callbackCacheList.length > 0
+            && now - siv3dPhotonPump.lastService >= 2 * siv3dPhotonPump.interval) {
+            _siv3dPhotonPumpCallback();
+        }
+    },
+    $siv3dPhotonPumpTick__deps: ["$siv3dPhotonClient", "$siv3dPhotonPump", "siv3dPhotonPumpCallback"],
+
+    siv3dPhotonSetPingInterval: function (interval) {
+        siv3dPhotonPump.pingInterval = interval;
+        siv3dPhotonStartPump();
+    },
+    siv3dPhotonSetPingInterval__sig: "vi",
+    siv3dPhotonSetPingInterval__deps: ["$siv3dPhotonPump", "$siv3dPhotonStartPump"],
+
+    siv3dPhotonSetPumpInterval: function (interval) {
+        siv3dPhotonPump.interval = interval;
+        siv3dPhotonStartPump();
     },
-    $siv3dPhotonSetPingInterval__deps: ["$siv3dPhotonClient"],
+    siv3dPhotonSetPumpInterval__sig: "vi",
+    siv3dPhotonSetPumpInterval__deps: ["$siv3dPhotonPump", "$siv3dPhotonStartPump"],
 
     siv3dPhotonGetServerTime: function () {
         return siv3dPhotonClient.getServerTimeMs();
@@ -422,7 +727,7 @@ mergeInto(LibraryManager.library, {
     siv3dPhotonCreateRoom__deps: ["$siv3dPhotonClient", "$siv3dPhotonCallbackCode", "$UTF32ToString"],
 
     siv3dPhotonReconnectAndRejoin: function () {
-        if (siv3dPhotonClient.waitingCallback) {
+        if (siv3dPhotonClient === null || siv3dPhotonClient.waitingCallback) {
             return false;
         }
 
@@ -430,14 +735,15 @@ mergeInto(LibraryManager.library, {
 
         const result = siv3dPhotonClient.reconnectAndRejoin();
 
+        // ロビーを通らないので ConnectReturn は来ない。マスターサーバの JoinGame の応答を待つ
         if (result) {
-            siv3dPhotonClient.waitingCallback = siv3dPhotonCallbackCode.ConnectReturn;
+            siv3dPhotonClient.waitingCallback = siv3dPhotonCallbackCode.JoinRoomReturn;
         }
 
         return result;
     },
-    siv3dPhotonCreateRoom__sig: "i",
-    siv3dPhotonCreateRoom__deps: ["$siv3dPhotonClient", "$siv3dPhotonCallbackCode"],
+    siv3dPhotonReconnectAndRejoin__sig: "i",
+    siv3dPhotonReconnectAndRejoin__deps: ["$siv3dPhotonClient", "$siv3dPhotonCallbackCode"],
 
     siv3dPhotonLeaveRoom: function (willComeBack) {
         if (siv3dPhotonClient.waitingCallback) {
@@ -18,6 +18,7 @@
 
 # include <Siv3D.hpp>
 # include "Multiplayer_Photon.hpp"
+# include <charconv>
 
 namespace s3d::detail {
 	static void LogIfError(const Multiplayer_Photon& photon, const int32 errorCode, const StringView errorString)
@@ -38,6 +39,21 @@ namespace s3d::detail
 		__attribute__((import_name("siv3dPhotonInitClient")))
 		void siv3dPhotonInitClient(const char32* appID, const char32* appVersion, bool verbose, uint8 protocol);
 
+		__attribute__((import_name("siv3dPhotonIsSdkLoaded")))
+		bool siv3dPhotonIsSdkLoaded();
+
+		__attribute__((import_name("siv3dPhotonIsSdkLoadFailed")))
+		bool siv3dPhotonIsSdkLoadFailed();
+
+		__attribute__((import_name("siv3dPhotonReloadSdk")))
+		void siv3dPhotonReloadSdk();
+
+		__attribute__((import_name("siv3dPhotonProbeRegions")))
+		bool siv3dPhotonProbeRegions(const char32* regions, int32 timeoutMillisec);
+
+		__attribute__((import_name("siv3dPhotonCancelRegionProbes")))
+		void siv3dPhotonCancelRegionProbes();
+
 		__attribute__((import_name("siv3dPhotonConnect")))
 		bool siv3dPhotonConnect(const char32* userID, const char32* region);
 
@@ -59,6 +75,9 @@ namespace s3d::detail
 		__attribute__((import_name("siv3dPhotonSetPingInterval")))
 		void siv3dPhotonSetPingInterval(int32 interval);
 
+		__attribute__((import_name("siv3dPhotonSetPumpInterval")))
+		void siv3dPhotonSetPumpInterval(int32 interval);
+
 		__attribute__((import_name("siv3dPhotonJoinRandomRoom")))
 		bool siv3dPhotonJoinRandomRoom(uint8 maxPlayers, MatchmakingMode matchmakingMode, const char32* filter);
 
@@ -136,6 +155,32 @@ namespace s3d::detail
 namespace s3d::detail
 {
 	void receiveRoomProperties(RoomPropertyTable& table);
+
+	// 処理の前後で計測用のフック (Multiplayer_Photon::onProcessBegin / onProcessEnd) を呼ぶ
+	class ScopedPhotonProcess
+	{
+	public:
+		ScopedPhotonProcess(Multiplayer_Photon& context, PhotonProcess process, int32 arg0 = 0, int32 arg1 = 0)
+			: m_context(context)
+			, m_process(process)
+		{
+			m_context.onProcessBegin(m_process, arg0, arg1);
+		}
+
+		~ScopedPhotonProcess()
+		{
+			m_context.onProcessEnd(m_process);
+		}
+
+		ScopedPhotonProcess(const ScopedPhotonProcess&) = delete;
+
+		ScopedPhotonProcess& operator =(const ScopedPhotonProcess&) = delete;
+
+	private:
+		Multiplayer_Photon& m_context;
+
+		PhotonProcess m_process;
+	};
 }
 
 // [WEB] PhotonDetail
@@ -162,6 +207,13 @@ namespace s3d
 
 		int32 m_pingInterval = 2000;
 
+		int32 m_pumpInterval = 50;
+
+		// sendEvent() で送るデータとオプションの JSON。送信のたびに確保しないよう使い回す
+		std::string m_messageBuffer;
+
+		String m_eventOptionBuffer;
+
 		bool joinRandomRoom(const int32 expectedMaxPlayers, MatchmakingMode matchmakingMode, StringView filter)
 		{
 			if (not InRange(expectedMaxPlayers, 0, 255))
@@ -360,6 +412,8 @@ namespace s3d
 		{
 			Blob blob = Base64::Decode(message, s3d::SkipValidation::Yes);
 
+			detail::ScopedPhotonProcess process{ m_context, PhotonProcess::ReceiveEvent, eventCode, static_cast<int32>(blob.size()) };
+
 			Deserializer<MemoryViewReader> reader{blob.data(), blob.size()};
 
 			if (m_context.m_table.contains(eventCode)) {
@@ -403,6 +457,15 @@ namespace s3d
 			m_context.onHostChange(newHostID, oldHostID);
 		}
 
+		void regionProbeReturn(const String& region, const int32 rttMillisec)
+		{
+			m_context.debugLog(U"[Multiplayer_Photon] Multiplayer_Photon::regionProbeReturn()");
+			m_context.debugLog(U"- [Multiplayer_Photon] region: {}"_fmt(region));
+			m_context.debugLog(U"- [Multiplayer_Photon] rttMillisec: {}"_fmt(rttMillisec));
+
+			m_context.regionProbeReturn(region, rttMillisec);
+		}
+
 		int32 getTimePingInterval()
 		{
 			return m_pingInterval;
@@ -413,6 +476,17 @@ namespace s3d
 			m_pingInterval = interval;
 			detail::siv3dPhotonSetPingInterval(interval);
 		}
+
+		int32 getPumpInterval()
+		{
+			return m_pumpInterval;
+		}
+
+		void setPumpInterval(int32 interval)
+		{
+			m_pumpInterval = interval;
+			detail::siv3dPhotonSetPumpInterval(interval);
+		}
 	};
 }
 
@@ -473,6 +547,8 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::GeneralCallback, callback, errorCode };
+
 			String errorString { errorString_ != nullptr ? errorString_ : U"" };
 
 			if (g_detail)
@@ -517,6 +593,8 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::ClientStateChange, state };
+
 			g_detail->m_clientState = static_cast<ClientState>(state);
 		}
 
@@ -525,6 +603,8 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::AppStateChange };
+
 			g_detail->m_countGamesRunning = countGamesRunning;
 			g_detail->m_countPlayersIngame = countPlayersIngame;
 			g_detail->m_countPlayersOnline = countPlayersOnline;
@@ -534,7 +614,9 @@ namespace s3d::detail
 		void siv3dPhotonActorJoinCallback(LocalPlayerID playerID, bool myself)
 		{
 			if (not g_detail) return;
-			
+
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::ActorJoin, playerID };
+
 			g_detail->joinRoomEventAction(playerID, myself);
 		}
 
@@ -543,6 +625,8 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::ActorLeave, playerID };
+
 			g_detail->leaveRoomEventAction(playerID, isSuspended);
 		}
 
@@ -551,6 +635,8 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::CustomEvent, playerID, code };
+
 			g_detail->customEventAction(playerID, code, message);
 
 			free(message);
@@ -569,6 +655,8 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::RoomListUpdate };
+
 			g_detail->onRoomListUpdate();
 		}
 
@@ -577,6 +665,8 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::RoomPropertiesChange };
+
 			RoomPropertyTable table {};
 
 			detail::receiveRoomProperties(table);
@@ -589,8 +679,33 @@ namespace s3d::detail
 		{
 			if (not g_detail) return;
 
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::HostChange, newHost, oldHost };
+
 			g_detail->onMasterClientChanged(newHost, oldHost);
 		}
+
+		__attribute__((used, export_name("siv3dPhotonPumpCallback")))
+		void siv3dPhotonPumpCallback()
+		{
+			if (not g_detail) return;
+
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::Pump };
+
+			siv3dPhotonService();
+		}
+
+		__attribute__((used, export_name("siv3dPhotonRegionProbeCallback")))
+		void siv3dPhotonRegionProbeCallback(char32* region_, int32 rttMillisec)
+		{
+			const String region{ region_ };
+			free(region_);
+
+			if (not g_detail) return;
+
+			detail::ScopedPhotonProcess process{ g_detail->m_context, PhotonProcess::RegionProbe, rttMillisec };
+
+			g_detail->regionProbeReturn(region, rttMillisec);
+		}
 	}
 }
 
@@ -641,13 +756,65 @@ namespace s3d::detail
 		return json.formatMinimum();
 	}
 
-	String MultiplayerEventToJSON(const MultiplayerEvent& eventOption)
+	// イベントのオプションは送信のたびに作るので、JSON オブジェクトを使わず文字列に直接書き出す
+	void AppendDigits(String& json, const char* first, const char* last)
 	{
-		JSON json{};
+		for (; first != last; ++first)
+		{
+			json.push_back(static_cast<char32>(*first));
+		}
+	}
+
+	void AppendJSONMember(String& json, StringView key, int32 value)
+	{
+		if (json.size() > 1)
+		{
+			json += U',';
+		}
+
+		json += U'"';
+		json.append(key);
+		json += U"\":";
+
+		char buffer[12];
+		const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+		AppendDigits(json, buffer, result.ptr);
+	}
+
+	void AppendJSONMember(String& json, StringView key, const Array<LocalPlayerID>& values)
+	{
+		if (json.size() > 1)
+		{
+			json += U',';
+		}
+
+		json += U'"';
+		json.append(key);
+		json += U"\":[";
+
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			if (i != 0)
+			{
+				json += U',';
+			}
+
+			char buffer[12];
+			const auto result = std::to_chars(std::begin(buffer), std::end(buffer), values[i]);
+			AppendDigits(json, buffer, result.ptr);
+		}
+
+		json += U']';
+	}
+
+	void MultiplayerEventToJSON(const MultiplayerEvent& eventOption, String& json)
+	{
+		json.clear();
+		json += U'{';
 
 		if (eventOption.targetGroup() != 0)
 		{
-			json[U"interestGroup"] = eventOption.targetGroup();
+			AppendJSONMember(json, U"interestGroup", eventOption.targetGroup());
 		}
 		EventCaching cache = EventCaching::DoNotCache;
 		ReceiverGroup receiver = ReceiverGroup::Others;
@@ -676,48 +843,51 @@ namespace s3d::detail
 			receiver = ReceiverGroup::MasterClient;
 			break;
 		};
-		json[U"cache"] = static_cast<int32>(cache);
+		AppendJSONMember(json, U"cache", static_cast<int32>(cache));
 		if (static_cast<int32>(receiver) != 0)
 		{
-			json[U"receivers"] = static_cast<int32>(receiver);
+			AppendJSONMember(json, U"receivers", static_cast<int32>(receiver));
 		}
 		if (eventOption.targetList())
 		{
-			json[U"targetActors"] = eventOption.targetList().value();
+			AppendJSONMember(json, U"targetActors", eventOption.targetList().value());
 		}
 
-		return json.formatMinimum();
+		json += U'}';
 	}
 
 	String MultiplayerEventToJSON(const Array<LocalPlayerID>& targets)
 	{
-		JSON json{};
+		String json = U"{";
 
 		if (targets.size() > 0)
 		{
-			json[U"targetActors"] = targets;
+			AppendJSONMember(json, U"targetActors", targets);
 		}
 
-		return json.formatMinimum();
+		json += U'}';
+		return json;
 	}
 
 	String MultiplayerEventToJSON(EventCaching cache)
 	{
-		JSON json{};
+		String json = U"{";
 
-		json[U"cache"] = static_cast<int32>(cache);
+		AppendJSONMember(json, U"cache", static_cast<int32>(cache));
 
-		return json.formatMinimum();
+		json += U'}';
+		return json;
 	}
 
 	String MultiplayerEventToJSON(EventCaching cache, const Array<LocalPlayerID>& targets)
 	{
-		JSON json{};
+		String json = U"{";
 
-		json[U"cache"] = static_cast<int32>(cache);
-		json[U"targetActors"] = targets;
+		AppendJSONMember(json, U"cache", static_cast<int32>(cache));
+		AppendJSONMember(json, U"targetActors", targets);
 
-		return json.formatMinimum();
+		json += U'}';
+		return json;
 	}
 	
 	void receiveRoomProperties(RoomPropertyTable& table)
@@ -1222,7 +1392,14 @@ namespace s3d
 			return false;
 		}
 
-		return detail::siv3dPhotonReconnectAndRejoin();
+		if (not detail::siv3dPhotonReconnectAndRejoin())
+		{
+			return false;
+		}
+
+		m_detail->m_clientState = ClientState::ConnectingToLobby;
+
+		return true;
 	}
 
 	int32 Multiplayer_Photon::getServerTimeMillisec() const
@@ -1274,6 +1451,76 @@ namespace s3d
 		return m_detail->setTimePingInterval(intervalMillisec);
 	}
 
+	int32 Multiplayer_Photon::getNetworkPumpIntervalMillisec() const
+	{
+		if (not m_detail)
+		{
+			return 0;
+		}
+
+		return m_detail->getPumpInterval();
+	}
+
+	void Multiplayer_Photon::setNetworkPumpIntervalMillisec(int32 intervalMillisec)
+	{
+		if (not m_detail)
+		{
+			return;
+		}
+
+		m_detail->setPumpInterval(Max(intervalMillisec, 0));
+	}
+
+	bool Multiplayer_Photon::isSdkLoaded() const
+	{
+		if (not m_detail)
+		{
+			return false;
+		}
+
+		return detail::siv3dPhotonIsSdkLoaded();
+	}
+
+	bool Multiplayer_Photon::isSdkLoadFailed() const
+	{
+		if (not m_detail)
+		{
+			return false;
+		}
+
+		return detail::siv3dPhotonIsSdkLoadFailed();
+	}
+
+	void Multiplayer_Photon::reloadSdk()
+	{
+		if (not m_detail)
+		{
+			return;
+		}
+
+		detail::siv3dPhotonReloadSdk();
+	}
+
+	bool Multiplayer_Photon::probeRegions(const Array<String>& regions, int32 timeoutMillisec)
+	{
+		if (not m_detail)
+		{
+			return false;
+		}
+
+		return detail::siv3dPhotonProbeRegions(regions.join(U",", U"", U"").c_str(), timeoutMillisec);
+	}
+
+	void Multiplayer_Photon::cancelRegionProbes()
+	{
+		if (not m_detail)
+		{
+			return;
+		}
+
+		detail::siv3dPhotonCancelRegionProbes();
+	}
+
 	int32 Multiplayer_Photon::getCountGamesRunning() const
 	{
 		if (not m_detail)
@@ -1382,13 +1629,19 @@ namespace s3d
 		int32 size = static_cast<int32>(writer->size());
 		const auto src = static_cast<const void*>(writer->getBlob().data());
 
-		std::string message{};
+		detail::ScopedPhotonProcess process{ *this, PhotonProcess::SendEvent, event.eventCode(), size };
+
+		std::string& message = m_detail->m_messageBuffer;
+		message.clear();
 		Base64::Encode(src, size, message);
 
+		String& options = m_detail->m_eventOptionBuffer;
+		detail::MultiplayerEventToJSON(event, options);
+
 		detail::siv3dPhotonRaiseEvent(
 			event.eventCode(),
 			message.data(),
-			detail::MultiplayerEventToJSON(event).data()
+			options.data()
 		);
 	}
 }
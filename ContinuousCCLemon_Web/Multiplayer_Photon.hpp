@@ -308,6 +308,35 @@ namespace s3d
 		Disconnecting,
 	};
 
+# if SIV3D_PLATFORM(WEB)
+	/// @brief 計測用のフック (Multiplayer_Photon::onProcessBegin / onProcessEnd) に渡される処理の種類
+	enum class PhotonProcess : uint8 {
+		/// @brief 接続・入室などの結果のコールバック。引数はコールバックの種類とエラーコード
+		GeneralCallback,
+		/// @brief クライアントの状態の変化。引数は状態
+		ClientStateChange,
+		AppStateChange,
+		/// @brief プレイヤーの入室・退室。引数はローカルプレイヤー ID
+		ActorJoin,
+		ActorLeave,
+		/// @brief イベントの受信。引数は送信者のローカルプレイヤー ID とイベントコード
+		CustomEvent,
+		/// @brief 受信したイベントの処理。引数はイベントコードとデータのサイズ
+		ReceiveEvent,
+		/// @brief sendEvent()。引数はイベントコードとデータのサイズ
+		SendEvent,
+		RoomListUpdate,
+		RoomPropertiesChange,
+		/// @brief ホストの変更。引数は新旧のホストのローカルプレイヤー ID
+		HostChange,
+		/// @brief update() と別のタイマーでの受信の処理
+		Pump,
+		/// @brief probeRegions() の結果。引数は接続にかかった時間（ミリ秒）
+		RegionProbe,
+		Count,
+	};
+# endif
+
 	class Multiplayer_Photon;
 
 	namespace detail
@@ -498,6 +527,44 @@ namespace s3d
 		/// @param intervalMillisec pingの更新頻度（ミリ秒）
 		void setPingIntervalMillisec(int32 intervalMillisec);
 
+# if SIV3D_PLATFORM(WEB)
+		/// @brief 描画のフレームとは別に受信したデータを処理する間隔を取得します。
+		/// @return 処理する間隔（ミリ秒）
+		[[nodiscard]]
+		int32 getNetworkPumpIntervalMillisec() const;
+
+		/// @brief 描画のフレームとは別に受信したデータを処理する間隔を設定します。
+		/// @param intervalMillisec 処理する間隔（ミリ秒）。0 の場合は update() でのみ処理します。
+		/// @remark Web Worker のタイマーで動くため、タブが非表示で update() が呼ばれない間も ping が送られ、受信したイベントのコールバックが呼ばれます。
+		void setNetworkPumpIntervalMillisec(int32 intervalMillisec);
+
+		/// @brief Photon の JavaScript SDK の読み込みが終わり、connect() できる状態かを返します。
+		/// @return connect() できる場合 true, それ以外の場合は false
+		/// @remark SDK は init() の後に非同期で読み込まれます。読み込み中に connect() を呼ぶと失敗します。
+		[[nodiscard]]
+		bool isSdkLoaded() const;
+
+		/// @brief Photon の JavaScript SDK の読み込みに失敗したかを返します。
+		/// @return 失敗して reloadSdk() を待っている場合 true, それ以外の場合は false
+		[[nodiscard]]
+		bool isSdkLoadFailed() const;
+
+		/// @brief 読み込みに失敗した Photon の JavaScript SDK を読み込み直します。
+		/// @remark 失敗していない場合は何もしません。読み込み直す間隔は呼び出し側で空けてください。
+		void reloadSdk();
+
+		/// @brief 各地域のサーバへの接続にかかる時間を測ります。結果は地域ごとに regionProbeReturn() で通知されます。
+		/// @param regions 測る地域の一覧
+		/// @param timeoutMillisec 1 地域を測る時間の上限（ミリ秒）。過ぎた地域は測れなかったものとして通知されます。
+		/// @return 測定を開始できた場合 true, SDK の読み込みが終わっていない場合は false
+		/// @remark 地域ごとに一時的な接続を作り、マスターサーバに接続できたところで切断します。
+		bool probeRegions(const Array<String>& regions, int32 timeoutMillisec);
+
+		/// @brief probeRegions() で始めた測定のうち、まだ終わっていないものを打ち切り、その接続を切断します。
+		/// @remark 打ち切った地域の結果は通知されません。
+		void cancelRegionProbes();
+# endif
+
 # if not SIV3D_PLATFORM(WEB)
 		/// @brief 受信したデータのサイズ（バイト）を返します。
 		/// @return 受信したデータのサイズ（バイト）
@@ -835,6 +902,24 @@ namespace s3d
 		/// @param oldHostPlayerID 古いホストのローカルプレイヤー ID
 		virtual void onHostChange(LocalPlayerID newHostPlayerID, LocalPlayerID oldHostPlayerID) {}
 
+# if SIV3D_PLATFORM(WEB)
+		/// @brief probeRegions() で測った 1 地域分の結果が通知されるときに呼ばれます。
+		/// @param region 地域
+		/// @param rttMillisec 接続にかかった時間（ミリ秒）。接続できなかった場合は -1
+		virtual void regionProbeReturn(const String& region, int32 rttMillisec) {}
+
+		/// @brief JS からのコールバックやイベントの送信の処理を始めるときに呼ばれます。計測用で、既定では何もしません。
+		/// @param process 処理の種類
+		/// @param arg0 処理ごとの値（PhotonProcess を参照）
+		/// @param arg1 処理ごとの値（PhotonProcess を参照）
+		/// @remark onProcessEnd() と対になって呼ばれ、入れ子になることがあります。
+		virtual void onProcessBegin(PhotonProcess process, int32 arg0, int32 arg1) {}
+
+		/// @brief onProcessBegin() で始めた処理が終わったときに呼ばれます。
+		/// @param process 処理の種類
+		virtual void onProcessEnd(PhotonProcess process) {}
+# endif
+
 		/// @brief ルームのイベントを受信した際に呼ばれます。
 		/// @param playerID 送信者のローカルプレイヤー ID
 		/// @param eventCode イベントコード
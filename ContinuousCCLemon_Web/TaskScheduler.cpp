@@ -0,0 +1,139 @@
+# include "TaskScheduler.hpp"
+# include <condition_variable>
+# include <deque>
+# include <mutex>
+# include <thread>
+
+namespace
+{
+	std::mutex g_mutex;
+
+	std::condition_variable g_condition;
+
+	std::deque<std::function<void()>> g_jobs;
+
+	bool g_stopping = false;
+
+# if CCLEMON_THREADS
+
+	std::vector<std::thread> g_workers;
+
+	void WorkerMain()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock lock{ g_mutex };
+				g_condition.wait(lock, [] { return (g_stopping or (not g_jobs.empty())); });
+
+				if (g_stopping) return;
+
+				job = std::move(g_jobs.front());
+				g_jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+
+# endif
+}
+
+void TaskScheduler::Start([[maybe_unused]] size_t workerCount)
+{
+# if CCLEMON_THREADS
+
+	if (not g_workers.empty()) return;
+
+	if (workerCount == 0)
+	{
+		const size_t concurrency = std::thread::hardware_concurrency();
+		workerCount = ((concurrency > 1) ? (concurrency - 1) : 1);
+	}
+	workerCount = Min(workerCount, MaxWorkers);
+
+	g_stopping = false;
+	for (size_t i = 0; i < workerCount; ++i)
+	{
+		g_workers.emplace_back(WorkerMain);
+	}
+
+# endif
+}
+
+void TaskScheduler::Stop()
+{
+	{
+		std::lock_guard lock{ g_mutex };
+		g_stopping = true;
+		g_jobs.clear();
+	}
+	g_condition.notify_all();
+
+# if CCLEMON_THREADS
+
+	for (auto& worker : g_workers)
+	{
+		worker.join();
+	}
+	g_workers.clear();
+
+# endif
+}
+
+size_t TaskScheduler::RunPending([[maybe_unused]] double budgetMillisec)
+{
+# if CCLEMON_THREADS
+
+	return 0;
+
+# else
+
+	// 少なくとも 1 つは実行して、予算が小さくても処理が進むようにする
+	const uint64 deadline = (Time::GetMicrosec() + static_cast<uint64>(budgetMillisec * 1000));
+	size_t count = 0;
+
+	do
+	{
+		std::function<void()> job;
+		{
+			std::lock_guard lock{ g_mutex };
+			if (g_jobs.empty()) break;
+
+			job = std::move(g_jobs.front());
+			g_jobs.pop_front();
+		}
+
+		job();
+		++count;
+	} while (Time::GetMicrosec() < deadline);
+
+	return count;
+
+# endif
+}
+
+size_t TaskScheduler::PendingCount()
+{
+	std::lock_guard lock{ g_mutex };
+	return g_jobs.size();
+}
+
+size_t TaskScheduler::WorkerCount() noexcept
+{
+# if CCLEMON_THREADS
+	return g_workers.size();
+# else
+	return 0;
+# endif
+}
+
+void TaskScheduler::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard lock{ g_mutex };
+		g_jobs.push_back(std::move(job));
+	}
+	g_condition.notify_one();
+}
@@ -0,0 +1,74 @@
+# pragma once
+# include <functional>
+# include <future>
+# include <Siv3D.hpp>
+
+/// @brief 1 のときワーカースレッドで処理を実行する（Web ではスレッド版のビルド (-pthread) のみ）
+# ifndef CCLEMON_THREADS
+#	if SIV3D_PLATFORM(WEB) && !defined(__EMSCRIPTEN_PTHREADS__)
+#		define CCLEMON_THREADS 0
+#	else
+#		define CCLEMON_THREADS 1
+#	endif
+# endif
+
+/// @brief メインスレッドの外で実行する処理を受け付けるワーカープール
+/// @remark スレッドが使えないビルドでは、RunPending() に渡した時間の範囲でメインスレッドで実行します
+class TaskScheduler
+{
+public:
+
+	/// @brief 起動するワーカーの最大数。Web ではリンク時の PTHREAD_POOL_SIZE と合わせてください
+	static constexpr size_t MaxWorkers = 4;
+
+	/// @brief ワーカースレッドで実行するビルドかを返します。
+	[[nodiscard]]
+	static constexpr bool IsThreaded() noexcept
+	{
+		return CCLEMON_THREADS;
+	}
+
+	/// @brief ワーカーを起動します。スレッドが使えないビルドでは何もしません。
+	/// @param workerCount ワーカーの数。0 なら論理コア数 - 1 (最大 MaxWorkers)
+	static void Start(size_t workerCount = 0);
+
+	/// @brief 残っている処理を破棄し、ワーカーを終了します。
+	static void Stop();
+
+	/// @brief 処理を追加します。
+	/// @return 結果。メインスレッドを止めないよう、wait_for(0s) で完了を確認してから get() してください
+	template <class Fty>
+	static std::future<std::invoke_result_t<Fty>> Submit(Fty&& f)
+	{
+		using Result = std::invoke_result_t<Fty>;
+
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Fty>(f));
+		std::future<Result> future = task->get_future();
+		Enqueue([task] { (*task)(); });
+		return future;
+	}
+
+	/// @brief スレッドが使えないとき、溜まっている処理を budgetMillisec の間だけ実行します。スレッドで実行するビルドでは何もしません。
+	/// @return 実行した処理の数
+	static size_t RunPending(double budgetMillisec);
+
+	/// @brief まだ始まっていない処理の数を返します。
+	[[nodiscard]]
+	static size_t PendingCount();
+
+	/// @brief 起動しているワーカーの数を返します。
+	[[nodiscard]]
+	static size_t WorkerCount() noexcept;
+
+private:
+
+	static void Enqueue(std::function<void()> job);
+};
+
+/// @brief future が完了していれば true を返します。
+template <class Type>
+[[nodiscard]]
+inline bool IsReady(const std::future<Type>& future)
+{
+	return future.valid() and (future.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready);
+}
@@ -0,0 +1,138 @@
+// Serves the release files from a cache keyed by the game version, and adds cross-origin
+// isolation headers so the pthreads build (ContinuousCCLemon_Web_mt.js) gets SharedArrayBuffer
+// on hosts that cannot set COOP/COEP themselves (e.g. GitHub Pages).
+
+// Filled in by tools/build_web_release.py. Left as is (development builds), nothing is cached.
+const CACHE_VERSION = "dev";
+const PRECACHE = [];
+
+const CACHE_NAME = `cclemon-${CACHE_VERSION}`;
+
+const CONTENT_TYPES = {
+    ".wasm": "application/wasm", // required for WebAssembly.instantiateStreaming
+    ".js": "text/javascript",
+    ".data": "application/octet-stream",
+    ".html": "text/html",
+    ".json": "application/json",
+    ".png": "image/png",
+};
+
+// Precompressed variants next to each file, in order of preference, and the DecompressionStream format for each.
+const ENCODINGS = [
+    { suffix: ".br", format: "brotli" },
+    { suffix: ".gz", format: "gzip" },
+];
+
+function isSupported(format) {
+    try {
+        new DecompressionStream(format);
+        return true;
+    } catch (e) {
+        return false;
+    }
+}
+
+function contentType(path) {
+    const extension = path.slice(path.lastIndexOf("."));
+    return CONTENT_TYPES[extension] ?? "application/octet-stream";
+}
+
+// Downloads the smallest variant the browser can decode and stores the decoded file.
+// GitHub Pages serves the .br/.gz files as opaque binaries, so they are decoded here rather than by the browser.
+async function fetchPrecached(entry) {
+    for (const { suffix, format } of ENCODINGS) {
+        if (!entry.encodings.includes(suffix) || !isSupported(format)) {
+            continue;
+        }
+
+        const response = await fetch(entry.path + suffix, { cache: "no-cache" });
+        if (response.ok) {
+            const body = response.body.pipeThrough(new DecompressionStream(format));
+            return new Response(body, { headers: { "Content-Type": contentType(entry.path) } });
+        }
+    }
+
+    const response = await fetch(entry.path, { cache: "no-cache" });
+    if (!response.ok) {
+        throw new Error(`${entry.path}: ${response.status}`);
+    }
+    return response;
+}
+
+self.addEventListener("install", (event) => {
+    // The first version takes over right away; updates wait until the pages using the old one are left (web-player.html).
+    if (!self.registration.active) {
+        self.skipWaiting();
+    }
+
+    if (PRECACHE.length === 0) {
+        return;
+    }
+
+    event.waitUntil(caches.open(CACHE_NAME).then((cache) => Promise.all(PRECACHE.map(async (entry) => {
+        await cache.put(new URL(entry.path, self.registration.scope), await fetchPrecached(entry));
+    }))));
+});
+
+self.addEventListener("activate", (event) => {
+    event.waitUntil(caches.keys()
+        .then((names) => Promise.all(names.filter((name) => name.startsWith("cclemon-") && name !== CACHE_NAME).map((name) => caches.delete(name))))
+        .then(() => self.clients.claim()));
+});
+
+self.addEventListener("message", (event) => {
+    if (event.data === "skipWaiting") {
+        self.skipWaiting();
+    }
+});
+
+function withIsolationHeaders(response) {
+    // Opaque responses cannot be rewritten; COEP "credentialless" lets them through without CORP.
+    if (response.status === 0) {
+        return response;
+    }
+
+    const headers = new Headers(response.headers);
+    headers.set("Cross-Origin-Embedder-Policy", "credentialless");
+    headers.set("Cross-Origin-Opener-Policy", "same-origin");
+    headers.set("Cross-Origin-Resource-Policy", "cross-origin");
+
+    return new Response(response.body, {
+        status: response.status,
+        statusText: response.statusText,
+        headers,
+    });
+}
+
+async function respond(request) {
+    if (PRECACHE.length > 0 && request.method === "GET") {
+        const url = new URL(request.url);
+        if (request.mode === "navigate" && url.pathname.endsWith("/")) {
+            url.pathname += "index.html";
+        }
+        url.search = "";
+
+        const cached = await caches.match(url, { cacheName: CACHE_NAME });
+        if (cached) {
+            return withIsolationHeaders(cached);
+        }
+    }
+
+    return withIsolationHeaders(await fetch(request));
+}
+
+self.addEventListener("fetch", (event) => {
+    const request = event.request;
+
+    // Workaround for https://bugs.chromium.org/p/chromium/issues/detail?id=823392
+    if (request.cache === "only-if-cached" && request.mode !== "same-origin") {
+        return;
+    }
+
+    // Photon and other cross-origin traffic is left to the browser.
+    if (new URL(request.url).origin !== self.location.origin) {
+        return;
+    }
+
+    event.respondWith(respond(request));
+});
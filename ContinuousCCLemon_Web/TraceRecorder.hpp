@@ -0,0 +1,255 @@
+# pragma once
+# include <atomic>
+# include <Siv3D.hpp>
+# if SIV3D_PLATFORM(WEB)
+#	include <emscripten.h>
+# endif
+
+/// @brief トレースイベントの種類
+/// @remark 記録にはこの構造体へのポインタだけを積むので、static な変数として定義してください
+struct TraceEventType
+{
+	/// @brief イベント名
+	const char32* name;
+
+	/// @brief カテゴリ名
+	const char32* category;
+
+	/// @brief 1 つ目の引数の名前。nullptr なら出力しない
+	const char32* arg0Name = nullptr;
+
+	/// @brief 2 つ目の引数の名前。nullptr なら出力しない
+	const char32* arg1Name = nullptr;
+};
+
+/// @brief フレーム・通信・シミュレーションのイベントを固定長のリングバッファに記録し、Chrome のトレース形式で書き出す
+/// @remark 無効の間は記録関数がフラグを 1 回見るだけなので、常に埋め込んでおいてよい
+/// @remark 記録は TaskScheduler のワーカーからも呼べます。有効・無効の切り替えと書き出しはメインスレッドで、タスクが動いていないときに行ってください
+class TraceRecorder
+{
+public:
+
+	/// @brief 記録できるイベント数。古いものから上書きされます
+	static constexpr size_t Capacity = (1 << 16);
+
+	enum class Phase : uint8
+	{
+		Begin,
+
+		End,
+
+		Instant,
+	};
+
+	struct Record
+	{
+		/// @brief 時刻（マイクロ秒）。Web では performance.now() と同じ基準
+		uint64 timestamp;
+
+		const TraceEventType* type;
+
+		int32 arg0;
+
+		int32 arg1;
+
+		Phase phase;
+
+		/// @brief 記録したスレッドの番号。最初に記録したスレッドから順に 0, 1, ...
+		uint8 thread;
+	};
+
+	[[nodiscard]]
+	static bool IsEnabled() noexcept
+	{
+		return Instance().m_enabled.load(std::memory_order_relaxed);
+	}
+
+	/// @brief 記録を有効・無効にします。有効にするとバッファはクリアされます。
+	static void SetEnabled(bool enabled)
+	{
+		auto& self = Instance();
+		if (self.m_enabled.load(std::memory_order_relaxed) == enabled) return;
+
+		if (enabled)
+		{
+			if (self.m_records.size() != Capacity)
+			{
+				self.m_records.resize(Capacity);
+			}
+			self.m_written.store(0, std::memory_order_relaxed);
+		}
+		self.m_enabled.store(enabled, std::memory_order_release);
+	}
+
+	static void Toggle()
+	{
+		SetEnabled(not IsEnabled());
+	}
+
+	[[nodiscard]]
+	static uint64 Now() noexcept
+	{
+# if SIV3D_PLATFORM(WEB)
+		return static_cast<uint64>(emscripten_get_now() * 1000.0);
+# else
+		return Time::GetMicrosec();
+# endif
+	}
+
+	static void Begin(const TraceEventType& type, int32 arg0 = 0, int32 arg1 = 0) noexcept
+	{
+		Push(type, Phase::Begin, arg0, arg1);
+	}
+
+	static void End(const TraceEventType& type) noexcept
+	{
+		Push(type, Phase::End, 0, 0);
+	}
+
+	static void Instant(const TraceEventType& type, int32 arg0 = 0, int32 arg1 = 0) noexcept
+	{
+		Push(type, Phase::Instant, arg0, arg1);
+	}
+
+	/// @brief 記録されているイベントの数を返します。
+	[[nodiscard]]
+	static size_t Size() noexcept
+	{
+		return static_cast<size_t>(Min<uint64>(Instance().m_written.load(std::memory_order_acquire), Capacity));
+	}
+
+	/// @brief バッファの内容を Chrome のトレース形式 (chrome://tracing, DevTools の Performance パネル) の JSON にします。
+	[[nodiscard]]
+	static String ToJSON()
+	{
+		const auto& self = Instance();
+
+		String json = U"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+		//リングが一周していると対応する Begin が消えた End が先頭に残るので、それは飛ばす。区間の入れ子はスレッドごとに数える
+		Array<HashTable<const TraceEventType*, int32>> depth;
+		bool first = true;
+
+		const uint64 written = self.m_written.load(std::memory_order_acquire);
+		const size_t count = Size();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Record& record = self.m_records[(written - count + i) % Capacity];
+			const TraceEventType& type = *record.type;
+
+			if (depth.size() <= record.thread)
+			{
+				depth.resize(record.thread + 1);
+			}
+
+			if (record.phase == Phase::Begin)
+			{
+				++depth[record.thread][record.type];
+			}
+			else if (record.phase == Phase::End)
+			{
+				auto& d = depth[record.thread][record.type];
+				if (d == 0) continue;
+				--d;
+			}
+
+			if (not first) json += U',';
+			first = false;
+
+			const char32 ph = (record.phase == Phase::Begin) ? U'B' : (record.phase == Phase::End) ? U'E' : U'i';
+			json += U"{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{}"_fmt(type.name, type.category, ph, (record.thread + 1), record.timestamp);
+
+			if (record.phase == Phase::Instant)
+			{
+				json += U",\"s\":\"t\"";
+			}
+
+			if (record.phase != Phase::End and type.arg0Name)
+			{
+				json += U",\"args\":{{\"{}\":{}"_fmt(type.arg0Name, record.arg0);
+				if (type.arg1Name)
+				{
+					json += U",\"{}\":{}"_fmt(type.arg1Name, record.arg1);
+				}
+				json += U'}';
+			}
+
+			json += U'}';
+		}
+
+		json += U"]}";
+		return json;
+	}
+
+	/// @brief バッファの内容を Chrome のトレース形式でファイルに保存します。
+	static bool Save(FilePathView path)
+	{
+		TextWriter writer{ path };
+		if (not writer) return false;
+
+		writer.write(ToJSON());
+		return true;
+	}
+
+private:
+
+	std::atomic<bool> m_enabled{ false };
+
+	Array<Record> m_records;
+
+	/// @brief これまでに記録した数。書き込む位置はスレッドごとにこれを進めて取る
+	std::atomic<uint64> m_written{ 0 };
+
+	std::atomic<uint8> m_threadCount{ 0 };
+
+	static void Push(const TraceEventType& type, Phase phase, int32 arg0, int32 arg1) noexcept
+	{
+		auto& self = Instance();
+		if (not self.m_enabled.load(std::memory_order_acquire)) return;
+
+		thread_local const uint8 thread = self.m_threadCount.fetch_add(1, std::memory_order_relaxed);
+
+		const uint64 index = self.m_written.fetch_add(1, std::memory_order_acq_rel);
+		self.m_records[index % Capacity] = Record{ Now(), &type, arg0, arg1, phase, thread };
+	}
+
+	static TraceRecorder& Instance() noexcept
+	{
+		static TraceRecorder instance;
+		return instance;
+	}
+};
+
+/// @brief スコープの間を 1 つのトレース区間として記録する
+class ScopedTrace
+{
+public:
+
+	explicit ScopedTrace(const TraceEventType& type, int32 arg0 = 0, int32 arg1 = 0) noexcept
+		: m_type{ type }
+		, m_enabled{ TraceRecorder::IsEnabled() }
+	{
+		if (m_enabled)
+		{
+			TraceRecorder::Begin(m_type, arg0, arg1);
+		}
+	}
+
+	~ScopedTrace()
+	{
+		if (m_enabled)
+		{
+			TraceRecorder::End(m_type);
+		}
+	}
+
+	ScopedTrace(const ScopedTrace&) = delete;
+
+	ScopedTrace& operator =(const ScopedTrace&) = delete;
+
+private:
+
+	const TraceEventType& m_type;
+
+	bool m_enabled;
+};
@@ -0,0 +1,140 @@
+# version 300 es
+
+//	プレイ画面のゲージ・ボタンを 1 パスで描く (Main.cpp の HUDRenderer)
+//	図形を囲む四角形に対して、各図形の符号付き距離から色を重ねる
+
+precision highp float;
+
+//
+//	Textures
+//
+uniform sampler2D Texture0;
+
+//
+//	PSInput
+//
+in vec4 Color;
+in vec2 UV;
+
+//
+//	PSOutput
+//
+layout(location = 0) out vec4 FragColor;
+
+//
+//	Constant Buffer
+//
+layout(std140) uniform PSConstants2D
+{
+	vec4 g_colorAdd;
+	vec4 g_sdfParam;
+	vec4 g_sdfOutlineColor;
+	vec4 g_sdfShadowColor;
+};
+
+layout(std140) uniform HUD
+{
+	vec4 g_bounds;			// xy: 描く四角形の左上, zw: 大きさ
+	vec4 g_enemyCircle;		// xy: 中心, z: 半径, w: タメの割合
+	vec4 g_chargeCircle;	// xy: 中心, z: 半径, w: タメの割合
+	vec4 g_enemyHpBar;		// xy: 左上, zw: 大きさ
+	vec4 g_hpBar;
+	vec4 g_attackButton;
+	vec4 g_defenseButton;
+	vec4 g_values;			// x: 敵の HP の割合, y: 自分の HP の割合, z: 敵の状態, w: 自分の状態
+};
+
+//
+//	Functions
+//
+const float TwoPi = 6.28318530718;
+
+const vec3 Black	= vec3(0.0, 0.0, 0.0);
+const vec3 White	= vec3(1.0, 1.0, 1.0);
+const vec3 Red		= vec3(1.0, 0.0, 0.0);
+const vec3 Green	= vec3(0.0, 128.0 / 255.0, 0.0);
+const vec3 Blue		= vec3(0.0, 0.0, 1.0);
+const vec3 Lime		= vec3(0.0, 1.0, 0.0);
+const vec3 Orange	= vec3(1.0, 165.0 / 255.0, 0.0);
+
+// 0: タメ, 1: 攻撃, 2: 防御 (PlayerState)
+vec3 StateColor(float state)
+{
+	return (state < 0.5) ? Green : ((state < 1.5) ? Red : Blue);
+}
+
+float Coverage(float d)
+{
+	return clamp(0.5 - d, 0.0, 1.0);
+}
+
+float CircleDistance(vec2 p, vec2 center, float r)
+{
+	return (length(p - center) - r);
+}
+
+float RectDistance(vec2 p, vec4 rect)
+{
+	vec2 halfSize = (rect.zw * 0.5);
+	vec2 d = (abs(p - (rect.xy + halfSize)) - halfSize);
+	return (length(max(d, 0.0)) + min(max(d.x, d.y), 0.0));
+}
+
+// 12 時の方向から時計回りに ratio 分だけの、半径 r0 から r1 までの輪
+float ArcCoverage(vec2 p, vec2 center, float r0, float r1, float ratio)
+{
+	vec2 v = (p - center);
+	float angle = atan(v.x, -v.y);
+	if (angle < 0.0)
+	{
+		angle += TwoPi;
+	}
+
+	if (angle > (clamp(ratio, 0.0, 1.0) * TwoPi))
+	{
+		return 0.0;
+	}
+
+	float r = length(v);
+	return Coverage(max(r0 - r, r - r1));
+}
+
+vec4 Over(vec4 dst, vec3 color, float alpha)
+{
+	float a = (alpha + dst.a * (1.0 - alpha));
+	vec3 rgb = (a > 0.0) ? ((color * alpha + dst.rgb * dst.a * (1.0 - alpha)) / a) : dst.rgb;
+	return vec4(rgb, a);
+}
+
+void main()
+{
+	vec2 p = (g_bounds.xy + UV * g_bounds.zw);
+	vec4 result = vec4(0.0);
+
+	// 敵の状態
+	result = Over(result, Black, Coverage(CircleDistance(p, g_enemyCircle.xy, g_enemyCircle.z + 10.0)));
+	result = Over(result, Orange, ArcCoverage(p, g_enemyCircle.xy, g_enemyCircle.z, g_enemyCircle.z + 10.0, g_enemyCircle.w));
+	result = Over(result, StateColor(g_values.z), Coverage(CircleDistance(p, g_enemyCircle.xy, g_enemyCircle.z)));
+
+	// 敵の HP
+	result = Over(result, Black, Coverage(RectDistance(p, g_enemyHpBar)));
+	result = Over(result, Lime, Coverage(RectDistance(p, vec4(g_enemyHpBar.xy, g_enemyHpBar.z * clamp(g_values.x, 0.0, 1.0), g_enemyHpBar.w))));
+
+	// 攻撃・防御ボタン。選択中のものは白を重ねる
+	result = Over(result, Red, Coverage(RectDistance(p, g_attackButton)));
+	result = Over(result, White, ((1.0 <= g_values.w) && (g_values.w < 1.5)) ? 0.5 * Coverage(RectDistance(p, g_attackButton)) : 0.0);
+	result = Over(result, Blue, Coverage(RectDistance(p, g_defenseButton)));
+	result = Over(result, White, (1.5 <= g_values.w) ? 0.5 * Coverage(RectDistance(p, g_defenseButton)) : 0.0);
+
+	// タメボタン
+	result = Over(result, Black, Coverage(CircleDistance(p, g_chargeCircle.xy, g_chargeCircle.z + 10.0)));
+	result = Over(result, Green, Coverage(CircleDistance(p, g_chargeCircle.xy, g_chargeCircle.z)));
+	result = Over(result, White, (g_values.w < 0.5) ? 0.5 * Coverage(CircleDistance(p, g_chargeCircle.xy, g_chargeCircle.z)) : 0.0);
+	result = Over(result, Orange, ArcCoverage(p, g_chargeCircle.xy, g_chargeCircle.z, g_chargeCircle.z + 10.0, g_chargeCircle.w));
+
+	// 自分の HP
+	result = Over(result, Black, Coverage(RectDistance(p, g_hpBar)));
+	result = Over(result, Lime, Coverage(RectDistance(p, vec4(g_hpBar.xy, g_hpBar.z * clamp(g_values.y, 0.0, 1.0), g_hpBar.w))));
+
+	FragColor = result;
+}
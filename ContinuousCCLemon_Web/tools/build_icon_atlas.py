@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Pre-rasterize the icons used by the game into one atlas.
+
+Writes resources/atlas/icons.png and resources/atlas/icons.json. IconAtlas in
+Main.cpp loads them at startup, so the icon fonts under resources/engine/font
+no longer need to be shipped or decompressed.
+
+Run again after adding or changing an icon in ICONS:
+
+    pip install pillow zstandard
+    python tools/build_icon_atlas.py
+"""
+
+import io
+import json
+from pathlib import Path
+
+import zstandard
+from PIL import Image, ImageDraw, ImageFont
+
+PROJECT_DIR = Path(__file__).resolve().parent.parent
+FONT_DIR = PROJECT_DIR / "resources" / "engine" / "font"
+OUTPUT_DIR = PROJECT_DIR / "resources" / "atlas"
+
+# Same fonts Siv3D picks for an Icon: Font Awesome below U+F0000, Material Design Icons above.
+AWESOME_SOLID = FONT_DIR / "fontawesome" / "fontawesome-solid.otf.zstdcmp"
+MATERIAL_DESIGN = FONT_DIR / "materialdesignicons" / "materialdesignicons-webfont.ttf.zstdcmp"
+
+# (code point, pixel size) for every Texture(..._icon, size) in Main.cpp
+ICONS = [
+    (0xF55A, 20),     # backSpaceIcon
+    (0xF04E5, 100),   # swordIcon
+    (0xF0499, 100),   # shieldIcon
+    (0xF00E8, 100),   # chargeIcon
+]
+
+ATLAS_WIDTH = 256
+PADDING = 2
+
+
+def load_font(path, size):
+    data = zstandard.ZstdDecompressor().decompress(path.read_bytes(), max_output_size=64 * 1024 * 1024)
+    return ImageFont.truetype(io.BytesIO(data), size)
+
+
+def rasterize(code, size):
+    font = load_font(MATERIAL_DESIGN if code >= 0xF0000 else AWESOME_SOLID, size)
+    left, top, right, bottom = font.getbbox(chr(code))
+    mask = Image.new("L", (right - left, bottom - top), 0)
+    ImageDraw.Draw(mask).text((-left, -top), chr(code), font=font, fill=255)
+    # white glyph with coverage in alpha, like Icon::CreateImage
+    image = Image.new("RGBA", mask.size, (255, 255, 255, 0))
+    image.putalpha(mask)
+    return image
+
+
+def main():
+    images = [(code, size, rasterize(code, size)) for code, size in ICONS]
+
+    # shelf packing, tallest first
+    placements = []
+    x = y = shelf_height = 0
+    for code, size, image in sorted(images, key=lambda item: -item[2].height):
+        if x + image.width + PADDING > ATLAS_WIDTH:
+            x, y, shelf_height = 0, y + shelf_height + PADDING, 0
+        placements.append((code, size, image, x, y))
+        x += image.width + PADDING
+        shelf_height = max(shelf_height, image.height)
+
+    atlas = Image.new("RGBA", (ATLAS_WIDTH, y + shelf_height), (255, 255, 255, 0))
+    manifest = {"texture": "icons.png", "icons": []}
+    for code, size, image, px, py in placements:
+        atlas.paste(image, (px, py))
+        manifest["icons"].append({"code": code, "size": size, "rect": [px, py, image.width, image.height]})
+
+    manifest["icons"].sort(key=lambda icon: (icon["code"], icon["size"]))
+
+    OUTPUT_DIR.mkdir(parents=True, exist_ok=True)
+    atlas.save(OUTPUT_DIR / "icons.png", optimize=True)
+    lines = ",\n".join(f"    {json.dumps(icon)}" for icon in manifest["icons"])
+    (OUTPUT_DIR / "icons.json").write_text(f'{{\n  "texture": "{manifest["texture"]}",\n  "icons": [\n{lines}\n  ]\n}}\n', encoding="utf-8")
+    print(f"{len(placements)} icons -> {OUTPUT_DIR / 'icons.png'} ({atlas.width}x{atlas.height})")
+
+
+if __name__ == "__main__":
+    main()
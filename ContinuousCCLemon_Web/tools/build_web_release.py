@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Prepare a Release web build for deployment (e.g. to docs/).
+
+Run by the post-build step of the Release configurations, or by hand:
+
+    pip install brotli        # optional; without it only .gz is written
+    python tools/build_web_release.py <output directory>
+
+- Writes Brotli (.br) and gzip (.gz) variants next to the .wasm/.js/.data files.
+- Writes service-worker.js from Templates/Embeddable/service-worker.js. Its cache
+  version is VERSION in Main.cpp plus a hash of the files, and the files in the
+  directory are precached. Repeat visits then start without touching the network,
+  and a new build replaces the cache as a whole.
+"""
+
+import argparse
+import gzip
+import hashlib
+import json
+import re
+from pathlib import Path
+
+try:
+    import brotli
+except ImportError:
+    brotli = None
+
+PROJECT_DIR = Path(__file__).resolve().parent.parent
+TEMPLATE = PROJECT_DIR / "Templates" / "Embeddable" / "service-worker.js"
+MAIN_CPP = PROJECT_DIR / "Main.cpp"
+
+PRECACHE_SUFFIXES = (".html", ".js", ".wasm", ".data", ".json", ".png")
+COMPRESS_SUFFIXES = (".js", ".wasm", ".data")
+
+# Smaller files are not worth a second request
+MIN_COMPRESS_SIZE = 1024
+
+
+def read_version():
+    match = re.search(r'String VERSION = U"([^"]+)";', MAIN_CPP.read_text(encoding="utf-8"))
+    if not match:
+        raise SystemExit(f"VERSION not found in {MAIN_CPP}")
+    return match.group(1)
+
+
+def compress(path):
+    data = path.read_bytes()
+    encodings = []
+
+    if len(data) < MIN_COMPRESS_SIZE:
+        return encodings
+
+    if brotli is not None:
+        path.with_name(path.name + ".br").write_bytes(brotli.compress(data, quality=11))
+        encodings.append(".br")
+
+    path.with_name(path.name + ".gz").write_bytes(gzip.compress(data, 9, mtime=0))
+    encodings.append(".gz")
+
+    return encodings
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("directory", type=Path, help="build output directory")
+    args = parser.parse_args()
+
+    if brotli is None:
+        print("brotli is not installed; writing .gz only")
+
+    files = sorted(path for path in args.directory.iterdir()
+                   if path.suffix in PRECACHE_SUFFIXES and path.name != "service-worker.js")
+
+    digest = hashlib.sha256()
+    precache = []
+
+    for path in files:
+        digest.update(path.name.encode())
+        digest.update(path.read_bytes())
+
+        encodings = compress(path) if path.suffix in COMPRESS_SUFFIXES else []
+        precache.append({"path": path.name, "encodings": encodings})
+
+    version = f"{read_version()}-{digest.hexdigest()[:8]}"
+
+    source = TEMPLATE.read_text(encoding="utf-8")
+    source = source.replace('const CACHE_VERSION = "dev";', f"const CACHE_VERSION = {json.dumps(version)};", 1)
+    source = source.replace("const PRECACHE = [];", f"const PRECACHE = {json.dumps(precache)};", 1)
+    (args.directory / "service-worker.js").write_text(source, encoding="utf-8")
+
+    print(f"service-worker.js: {version}, {len(precache)} files")
+
+
+if __name__ == "__main__":
+    main()
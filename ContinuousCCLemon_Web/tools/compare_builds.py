@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Compare the web builds (Release, ReleaseNoAsyncify, ReleaseThreads).
+
+Download size: pass the output directories of the builds. The .wasm/.js/.data
+files in each are listed raw and gzip-compressed.
+
+Load time and per-frame cost: open each build, play until the first match
+starts, and save the "[startup] {...}" lines from the browser console into a
+text file (one or more sessions per build). Pass the file with --startup.
+The records are grouped by their "build" field ("asyncify", "noasyncify",
+"mt"), and the medians of the marks and of frameCost are shown. frameCost
+is the mean time of one frame body until the first match, excluding the wait
+for the next frame.
+
+    python tools/compare_builds.py out/Release out/ReleaseNoAsyncify --startup sessions.txt
+"""
+
+import argparse
+import gzip
+import json
+import statistics
+from collections import defaultdict
+from pathlib import Path
+
+SUFFIXES = (".wasm", ".js", ".data")
+
+MARKS = ("scriptLoaded", "runtimeInitialized", "main", "interactive", "photonSdkLoaded", "lobby", "firstPlaying")
+
+
+def print_sizes(directories):
+    print(f"{'build':<24}{'file':<40}{'raw KiB':>10}{'gzip KiB':>10}")
+
+    for directory in directories:
+        totals = [0, 0]
+
+        for path in sorted(Path(directory).iterdir()):
+            if path.suffix not in SUFFIXES:
+                continue
+
+            data = path.read_bytes()
+            raw, compressed = len(data), len(gzip.compress(data, 9))
+            totals[0] += raw
+            totals[1] += compressed
+            print(f"{Path(directory).name:<24}{path.name:<40}{raw / 1024:>10.1f}{compressed / 1024:>10.1f}")
+
+        print(f"{Path(directory).name:<24}{'(total)':<40}{totals[0] / 1024:>10.1f}{totals[1] / 1024:>10.1f}")
+
+
+def load_startup_records(path):
+    records = []
+
+    for line in Path(path).read_text(encoding="utf-8").splitlines():
+        _, found, body = line.partition("[startup]")
+        if found:
+            records.append(json.loads(body))
+
+    return records
+
+
+def print_startup(records):
+    groups = defaultdict(list)
+    for record in records:
+        groups[record.get("build", "asyncify")].append(record)
+
+    print(f"{'build':<12}{'sessions':>10}" + "".join(f"{mark:>20}" for mark in MARKS) + f"{'frameCost':>12}")
+
+    for build, group in sorted(groups.items()):
+        row = f"{build:<12}{len(group):>10}"
+
+        for mark in MARKS:
+            times = [r["marks"][mark] for r in group if mark in r["marks"]]
+            row += f"{statistics.median(times):>18.1f}ms" if times else f"{'-':>20}"
+
+        costs = [r["frameCost"] for r in group if "frameCost" in r]
+        row += f"{statistics.median(costs):>10.3f}ms" if costs else f"{'-':>12}"
+        print(row)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("directories", nargs="*", help="build output directories")
+    parser.add_argument("--startup", help="text file with [startup] lines copied from the console")
+    args = parser.parse_args()
+
+    if args.directories:
+        print_sizes(args.directories)
+
+    if args.startup:
+        if args.directories:
+            print()
+        print_startup(load_startup_records(args.startup))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Local stand-in relays for trying out the region selection (ConnectionManager in Main.cpp).
+
+Each relay accepts WebSocket connections on one port and answers the handshake
+after a fixed delay, so the probe in MultiplayerPhoton.js measures that delay
+plus the local round trip. "off" refuses the connection to simulate a region
+that cannot be reached.
+
+    python tools/latency_relay.py 9101=30 9102=150 9103=off --jitter 10
+
+Then open the game with the relays in place of the Photon regions:
+
+    web-player.html?photonProbe=jp=ws://localhost:9101,kr=ws://localhost:9102,asia=ws://localhost:9103
+
+The console shows the "[probe] ..." line with the measured times and
+"[connect] ..." with the chosen region. The game itself still connects to
+Photon in the chosen region. While photonProbe is given, the saved region is
+ignored and the regions are measured on every start.
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import random
+
+WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+
+def parse_relay(spec):
+    port, _, latency = spec.partition("=")
+    if not port.isdigit() or not latency:
+        raise argparse.ArgumentTypeError(f"expected PORT=MILLISECONDS or PORT=off: {spec}")
+    return int(port), (None if latency == "off" else float(latency))
+
+
+async def read_request(reader):
+    headers = {}
+    request_line = await reader.readline()
+
+    while True:
+        line = await reader.readline()
+        if line in (b"\r\n", b"\n", b""):
+            break
+        name, _, value = line.decode("latin-1").partition(":")
+        headers[name.strip().lower()] = value.strip()
+
+    return request_line, headers
+
+
+def make_handler(port, latency, jitter):
+    async def handle(reader, writer):
+        try:
+            request_line, headers = await read_request(reader)
+            key = headers.get("sec-websocket-key")
+
+            if latency is None or key is None:
+                writer.write(b"HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n")
+                await writer.drain()
+                return
+
+            delay = max(0.0, latency + random.uniform(-jitter, jitter))
+            await asyncio.sleep(delay / 1000)
+
+            accept = base64.b64encode(hashlib.sha1((key + WEBSOCKET_GUID).encode()).digest()).decode()
+            response = ("HTTP/1.1 101 Switching Protocols\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        f"Sec-WebSocket-Accept: {accept}\r\n\r\n")
+            writer.write(response.encode())
+            await writer.drain()
+            print(f"{port}: {request_line.decode('latin-1').strip()} after {delay:.0f}ms")
+
+            # Frames are not interpreted; the connection is held until the browser closes it.
+            while await reader.read(4096):
+                pass
+        except ConnectionError:
+            pass
+        finally:
+            writer.close()
+
+    return handle
+
+
+async def serve(relays, jitter):
+    servers = []
+
+    for port, latency in relays:
+        servers.append(await asyncio.start_server(make_handler(port, latency, jitter), "localhost", port))
+        print(f"ws://localhost:{port}: {'off' if latency is None else f'{latency:.0f}ms'}")
+
+    await asyncio.gather(*(server.serve_forever() for server in servers))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("relays", nargs="+", type=parse_relay, help="PORT=MILLISECONDS or PORT=off")
+    parser.add_argument("--jitter", type=float, default=0, help="random variation of the delay (ms)")
+    args = parser.parse_args()
+
+    try:
+        asyncio.run(serve(args.relays, args.jitter))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()